@@ -0,0 +1,275 @@
+#include <core.h>
+#include <estimate.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+using namespace std;
+using namespace ca;
+
+// every heap allocation in the process is counted, to report allocations per op
+static atomic<long long> allocations { 0 };
+
+void *operator new(size_t n)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    if (void *p = malloc(n ? n : 1))
+        return p;
+    throw bad_alloc();
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+namespace {
+
+template<typename t>
+void keep(const t &v)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "g"(&v) : "memory");
+#else
+    static volatile const void *sink;
+    sink = &v;
+#endif
+}
+
+struct null_ui : ui
+{
+    ui &operator<<(int) override { return *this; }
+    ui &operator<<(double) override { return *this; }
+    ui &operator<<(const str &) override { return *this; }
+    ui &operator<<(const char *) override { return *this; }
+    ui &operator<<(symbol) override { return *this; }
+};
+
+struct bench
+{
+    double min_ms = 200;
+    const char *filter = nullptr;
+    bool first = true;
+
+    // runs op in doubling batches for at least min_ms and prints a json record
+    template<typename op_t>
+    void run(const char *name, int param, op_t op)
+    {
+        if (filter && !strstr(name, filter))
+            return;
+        using clock = chrono::steady_clock;
+        // warm up, so buffers that are reused have grown already
+        op();
+        long long ops = 0;
+        long long allocs = 0;
+        double ns = 0;
+        for (long long batch = 1; ns < min_ms * 1e6; batch *= 2) {
+            const long long a = allocations.load();
+            const auto start = clock::now();
+            for (long long i = 0; i < batch; ++i)
+                op();
+            ns += chrono::duration<double, nano>(clock::now() - start).count();
+            allocs += allocations.load() - a;
+            ops += batch;
+        }
+        cout << (first ? "" : ",\n")
+             << "    {\"name\": \"" << name << "\", \"param\": " << param
+             << ", \"ops\": " << ops
+             << ", \"ns_per_op\": " << ns / ops
+             << ", \"allocs_per_op\": " << double(allocs) / ops << "}";
+        first = false;
+    }
+};
+
+// the starting 5 rooms plus more herbalists, sellers, mass sellers and blenders
+state with_rooms(int rooms)
+{
+    state s;
+    s.reset();
+    s.inc_gold(1 << 30);
+    const int shop[] = { 0, 2, 3, 1 };
+    for (int i = 0; s.room_count() < rooms; ++i)
+        s.btn(ui::mk_room_buy(shop[i % 4]));
+    s.inc_gold(-s.gold());
+    return s;
+}
+
+void fill_pool(state &s, int dice)
+{
+    for (int i = 0; i < dice; ++i)
+        s.inc_dice(dice_pool::hash(i % dice_pool::faces));
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    bench b;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--min-ms"))
+            b.min_ms = atof(argv[i + 1]);
+        else if (!strcmp(argv[i], "--filter"))
+            b.filter = argv[i + 1];
+        else {
+            cerr << "usage: cat_bench [--min-ms ms] [--filter name]\n";
+            return 1;
+        }
+    }
+    const int room_counts[] = { 5, 10, 25, 50, ui::max_rooms };
+    const int pool_sizes[] = { 0, 1, 6, 60, 600 };
+
+    cout << "{\n  \"benchmarks\": [\n";
+
+    for (int rooms : room_counts) {
+        state s = with_rooms(rooms);
+        b.run("next_roll", rooms, [&] {
+            s.next_roll();
+            // stay away from debt collectors arriving every 100 rolls
+            if (s.rolls >= 99)
+                s.rolls = 1;
+        });
+        b.run("state/copy", rooms, [&] {
+            state copy = s;
+            keep(copy);
+        });
+        b.run("state/fork", rooms, [&] {
+            state f = s.fork();
+            f.next_roll();
+            keep(f);
+        });
+    }
+
+    for (int rooms : room_counts) {
+        state s = with_rooms(rooms);
+        room_profile profile;
+        s.profile_ = &profile;
+        b.run("next_roll/profiled", rooms, [&] {
+            s.next_roll();
+            if (s.rolls >= 99)
+                s.rolls = 1;
+        });
+    }
+
+    for (int count : pool_sizes) {
+        state s;
+        fill_pool(s, count);
+        b.run("has_dice/seller", count, [&] {
+            keep(s.find_dice(dice_query::any{}));
+        });
+        b.run("has_dice/splitter", count, [&] {
+            dice_hash dh = s.find_dice(dice_query::max_value{4, 3});
+            if (!dh)
+                dh = s.find_dice(dice_query::min_value{3});
+            keep(dh);
+        });
+        b.run("has_dice/lambda", count, [&] {
+            keep(s.has_dice([](dice d) { return d.value() > 2; }, 1,
+                            [](dice my, dice best) { return my.value() <= 4 && my.value() > best.value(); }));
+        });
+        const dice::filter f = [](dice d) { return d.value() > 2; };
+        const dice::comparer c = [](dice my, dice best) { return my.value() <= 4 && my.value() > best.value(); };
+        b.run("has_dice/std_function", count, [&] {
+            keep(s.has_dice(f, 1, c));
+        });
+    }
+
+    for (int rooms : room_counts) {
+        state s = with_rooms(rooms);
+        b.run("estimate", rooms, [&] {
+            keep(estimate_income(s));
+        });
+        income_estimator cache;
+        b.run("estimate/cached", rooms, [&] {
+            keep(cache.get(s));
+        });
+    }
+
+    for (int rolls : { 100, 1000 }) {
+        state s;
+        b.run("skip", rolls, [&] {
+            s.reset();
+            skip_until until;
+            until.rolls = rolls;
+            until.debt = false;
+            keep(s.skip(until));
+        });
+    }
+
+    const int roll_counts[] = { 1, 8, 64, 256, 4096 };
+    for (int count : roll_counts) {
+        state s;
+        int rolled[dice_pool::faces] = {};
+        b.run("roll_d6s/exact", count, [&] {
+            s.roll_d6s(count, rolled);
+            keep(rolled);
+        });
+        s.dice_mode_ = state::dice_fast;
+        b.run("roll_d6s/fast", count, [&] {
+            s.roll_d6s(count, rolled);
+            keep(rolled);
+        });
+    }
+
+    {
+        state s;
+        b.run("inc_dice", 1, [&] {
+            s.inc_dice(dh_d6_3, 1);
+            s.inc_dice(dh_d6_3, -1);
+        });
+        b.run("inc_gold", 1, [&] {
+            s.inc_gold(7);
+            s.inc_gold(-7);
+        });
+    }
+
+    for (int rooms : room_counts) {
+        state s = with_rooms(rooms);
+        fill_pool(s, 60);
+        null_ui nothing;
+        b.run("draw/null_ui", rooms, [&] { s.draw(nothing); });
+        strout text;
+        ui_cmd cmd(text);
+        b.run("draw/ui_cmd", rooms, [&] {
+            text.str("");
+            s.draw(cmd);
+        });
+        ui_html html;
+        b.run("draw/ui_html", rooms, [&] {
+            html.clear();
+            s.draw(html);
+        });
+    }
+
+    for (int rooms : room_counts) {
+        state s = with_rooms(rooms);
+        const ui::signal down = ui::mk_room_action(0, ui::room_action_move_down);
+        const ui::signal up = ui::mk_room_action(1, ui::room_action_move_up);
+        b.run("btn/move", rooms, [&] {
+            s.btn(down);
+            s.btn(up);
+        });
+        const ui::signal upgrade_last = ui::mk_room_upgrade(rooms - 1, 0);
+        b.run("btn/upgrade_unaffordable", rooms, [&] { s.btn(upgrade_last); });
+    }
+
+    {
+        state s;
+        static constexpr upgrade_curve curve(1, linear_growing_number(1),
+                                             200, multiply_growing_number(1.5),
+                                             8, "Number of activations");
+        const upgrade proto(curve);
+        upgrade u = proto;
+        b.run("upgrade/level_up", 1, [&] {
+            // back to the same gold every op, so it never grows past int
+            s.inc_gold((1 << 20) - s.gold());
+            if (!u.level_up(s))
+                u = proto;
+        });
+    }
+
+    cout << "\n  ]\n}\n";
+    return 0;
+}
@@ -0,0 +1,387 @@
+#include <core.h>
+#include <estimate.h>
+#include <sim.h>
+#include <snapshot.h>
+#include <stream.h>
+#include <varint.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace ca;
+
+// consistency checks of the core, run by ctest: cat_check [name...] runs the named ones or all
+
+namespace {
+
+unsigned long long fnv(unsigned long long h, const void *data, size_t n)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < n; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// everything a snapshot keeps, folded into a number
+unsigned long long digest(const state &s, unsigned long long h = 14695981039346656037ull)
+{
+    snapshot shot;
+    if (!s.save(shot))
+        return 0;
+    return fnv(h, &shot, sizeof(shot));
+}
+
+// presses random buys, upgrades, moves and sells between rolls, the same ones for the same seed
+void press_random(state &s, philox &r)
+{
+    for (int k = 0; k < 3; ++k) {
+        switch (r() % 5) {
+        case 0:
+            if (s.room_count() < ui::max_rooms - 10)
+                s.btn(ui::mk_room_buy(int(r() % (s.shop_count() - 1))));
+            break;
+        case 1:
+            if (s.room_count()) {
+                const int room = int(r() % s.room_count());
+                if (s.room_at(room).upgrade_count())
+                    s.btn(ui::mk_room_upgrade(room, int(r() % s.room_at(room).upgrade_count())));
+            }
+            break;
+        case 2:
+            if (s.room_count() > 1)
+                s.btn(ui::mk_room_action(int(r() % (s.room_count() - 1)), ui::room_action_move_down));
+            break;
+        case 3:
+            if (s.room_count() > 1 && r() % 8 == 0)
+                s.btn(ui::mk_room_action(int(r() % s.room_count()), ui::room_action_sell));
+            break;
+        }
+    }
+}
+
+// plays a game with random presses and digests the state after every roll;
+// with frames attached every activation is a step of its own, without them
+// rooms activate in bulk and runs of rooms in one pass
+unsigned long long play_digest(unsigned seed, int rolls, bool frames)
+{
+    state s;
+    frame_scheduler f;
+    s.seed(seed);
+    s.reset();
+    if (frames)
+        s.frames_ = &f;
+    philox r(seed, 1);
+    unsigned long long h = 14695981039346656037ull;
+    while (s.game_state() == state::gaming && s.rolls < rolls) {
+        press_random(s, r);
+        s.next_roll();
+        f.clear();
+        h = digest(s, h);
+    }
+    return h;
+}
+
+// the bulk paths (room::activate_bulk, room::activate_run) give the same game
+// as one activation at a time
+bool check_bulk()
+{
+    int bad = 0;
+    for (unsigned seed = 0; seed < 200; ++seed) {
+        if (play_digest(seed, 600, false) != play_digest(seed, 600, true)) {
+            cout << "  seed " << seed << ": bulk and single step games differ\n";
+            bad++;
+        }
+    }
+    return !bad;
+}
+
+// a state at roll 199 whose collector is paid off in the roll that brings the next one
+state paying_off_at_arrival()
+{
+    state s;
+    snapshot shot;
+    s.save(shot);
+    snapshot_room &collector = shot.rooms[shot.rooms_count++];
+    collector.type = rt_debt_collector;
+    collector.waits_gold = 100;
+    collector.waits_gold_total = 2000;
+    shot.gold = 5000;
+    shot.rolls = 199;
+    if (!s.load(shot))
+        cout << "  can't load the state\n";
+    return s;
+}
+
+// state::skip stops right after a debt collector arrives, even if the debt count stays
+bool check_skip_debt()
+{
+    state s = paying_off_at_arrival();
+    const skip_summary sum = s.skip(skip_until{});
+    if (sum.stopped != skip_summary::debt_arrived || sum.rolls != 1 || s.rolls != 200) {
+        cout << "  stopped " << sum.stopped << " after " << sum.rolls << " rolls at roll " << s.rolls << "\n";
+        return false;
+    }
+    return true;
+}
+
+// state::catch_up stops at the same arrival, with rolls due left over
+bool check_catch_up_debt()
+{
+    state s = paying_off_at_arrival();
+    catch_up_options opt;
+    const catch_up_summary sum = s.catch_up(opt.seconds_per_roll * 5000, opt);
+    if (sum.stopped != skip_summary::debt_arrived || sum.rolls != 1 || sum.due != 5000 || s.rolls != 200) {
+        cout << "  stopped " << sum.stopped << " after " << sum.rolls << " of " << sum.due
+             << " rolls at roll " << s.rolls << "\n";
+        return false;
+    }
+    return true;
+}
+
+// plays a fork of s past a debt payment, on even streams after every kind of press,
+// on odd ones only rolling, so the collector changes while the fork still shares it;
+// false if nothing was paid
+bool play_fork(const state &s, unsigned stream)
+{
+    state f = s.fork();
+    f.seed(7, stream);
+    f.inc_gold(100000);
+    const int debt = f.debts().gold;
+    if (stream % 2 == 0) {
+        f.buy_room(0);
+        f.btn(ui::mk_room_upgrade(0, 0));
+        f.btn(ui::mk_room_upgrade(f.rooms_of(rt_debt_collector).front(), 0));
+        f.move_room(0, 1);
+        f.sell_room(1);
+    }
+    for (int i = 0; i < 5; ++i)
+        f.next_roll();
+    return f.debts().gold < debt;
+}
+
+// forks share rooms and their layout with the original, also forks played on other threads,
+// yet nothing done on a fork shows in the original
+bool check_fork()
+{
+    state s;
+    s.seed(3);
+    s.reset();
+    while (s.rolls < 100) {
+        policy_greedy(s);
+        s.next_roll();
+    }
+    if (!s.debts().count) {
+        cout << "  no debt collector waits at roll " << s.rolls << "\n";
+        return false;
+    }
+    const unsigned long long before = digest(s);
+    list<char> paid(65);
+    paid[0] = play_fork(s, 0);
+    run_parallel(64, 4, [&](state &, int i) { paid[i + 1] = play_fork(s, unsigned(i + 1)); });
+    const int unpaid = int(count(paid.begin(), paid.end(), 0));
+    bool ok = true;
+    if (unpaid) {
+        cout << "  " << unpaid << " forks paid nothing to the collector\n";
+        ok = false;
+    }
+    if (digest(s) != before) {
+        cout << "  the original changed\n";
+        ok = false;
+    }
+    return ok;
+}
+
+// estimate_income against the mean and variance of the gold and dice of many sampled rolls,
+// and the share of them lost, within 5 standard errors
+bool estimate_matches(const state &s, const char *layout)
+{
+    const income_estimate e = estimate_income(s, 1 << 20);
+    snapshot shot;
+    s.save(shot);
+    const int n = 50000;
+    double g = 0, g2 = 0, d = 0, d2 = 0, lost = 0;
+    state t;
+    for (int i = 0; i < n; ++i) {
+        t.load(shot);
+        t.seed(unsigned(i + 1), 77);
+        t.next_roll();
+        const double gold = t.gold() - shot.gold;
+        const double dice = t.pool().total() - s.pool().total();
+        g += gold;
+        g2 += gold * gold;
+        d += dice;
+        d2 += dice * dice;
+        lost += t.game_state() == state::lost_by_debt;
+    }
+    g /= n;
+    d /= n;
+    lost /= n;
+    const double g_var = g2 / n - g * g;
+    const double d_var = d2 / n - d * d;
+    auto near_mean = [](double est, double mc, double var) {
+        return fabs(est - mc) <= 5 * sqrt(max(0.0, var) / n) + 1e-6;
+    };
+    auto near_var = [](double est, double mc) { return fabs(est - mc) <= 0.1 * est + 1e-6; };
+    const bool ok = near_mean(e.gold, g, e.gold_var) && near_var(e.gold_var, g_var)
+            && near_mean(e.dice, d, e.dice_var) && near_var(e.dice_var, d_var)
+            && near_mean(e.lost, lost, e.lost * (1 - e.lost)) && e.dropped == 0;
+    if (!ok)
+        cout << "  " << layout << ": estimated gold " << e.gold << " (var " << e.gold_var
+             << "), dice " << e.dice << " (var " << e.dice_var << "), lost " << e.lost
+             << "; sampled gold " << g << " (var " << g_var << "), dice " << d
+             << " (var " << d_var << "), lost " << lost << ", dropped " << e.dropped << "\n";
+    return ok;
+}
+
+bool check_estimate()
+{
+    bool ok = true;
+    {
+        state s;
+        s.inc_gold(100000);
+        s.sell_room(4);
+        s.buy_room(1);
+        s.buy_room(1);
+        s.buy_room(3);
+        for (int i = 0; i < 3; ++i) {
+            s.btn(ui::mk_room_upgrade(4, 0));
+            s.btn(ui::mk_room_upgrade(0, 0));
+            s.btn(ui::mk_room_upgrade(6, 0));
+            s.btn(ui::mk_room_upgrade(6, 1));
+        }
+        s.move_room(6, -6);
+        s.inc_dice(dh_d6_6, 3);
+        s.inc_dice(dh_d6_4, 2);
+        ok = estimate_matches(s, "splitters and a mass seller") && ok;
+    }
+    {
+        state s;
+        s.insert_room(5, s.make_room<debt_collector>(500));
+        s.insert_room(6, s.make_room<debt_collector>(500));
+        s.inc_gold(100);
+        ok = estimate_matches(s, "two debts") && ok;
+    }
+    {
+        state s;
+        s.insert_room(5, s.make_room<debt_collector>(500));
+        s.inc_gold(30);
+        ok = estimate_matches(s, "a debt") && ok;
+    }
+    state s;
+    s.seed(1);
+    s.reset();
+    for (int roll : { 60, 150, 250 }) {
+        while (s.rolls < roll && s.game_state() == state::gaming) {
+            policy_greedy(s);
+            s.next_roll();
+        }
+        ok = estimate_matches(s, ("greedy at roll " + to_string(roll)).c_str()) && ok;
+    }
+    return ok;
+}
+
+// reads the bytes back from the start of a temporary file, false if it can't be made
+bool replay_bytes(const str &bytes, ui &o)
+{
+    FILE *f = tmpfile();
+    if (!f)
+        return false;
+    fwrite(bytes.data(), 1, bytes.size(), f);
+    fflush(f);
+    rewind(f);
+    ui_stream_reader r(fileno(f));
+    const bool ok = r.replay(o);
+    fclose(f);
+    return ok;
+}
+
+// a game drawn into a ui_stream and replayed into ui_cmd gives the same html as drawn
+// into ui_cmd directly, and a string longer than a stream allows is malformed, not allocated
+bool check_stream()
+{
+    FILE *f = tmpfile();
+    if (!f) {
+        cout << "  can't make a temporary file\n";
+        return false;
+    }
+    ostringstream direct;
+    {
+        ui_cmd d(direct);
+        ui_stream o(fileno(f));
+        state s;
+        s.seed(5);
+        s.reset();
+        for (int i = 0; i < 300 && s.game_state() == state::gaming; ++i) {
+            policy_greedy(s);
+            s.next_roll();
+            s.draw(d);
+            s.draw(o);
+        }
+        if (!o.ok()) {
+            cout << "  can't write the stream\n";
+            fclose(f);
+            return false;
+        }
+    }
+    rewind(f);
+    ostringstream replayed;
+    ui_cmd r(replayed);
+    ui_stream_reader reader(fileno(f));
+    const bool ok = reader.replay(r);
+    fclose(f);
+    bool same = ok && replayed.str() == direct.str();
+    if (!same)
+        cout << "  replayed " << reader.frames() << " frames, " << (ok ? "ok" : "malformed")
+             << ", " << replayed.str().size() << " bytes of html against " << direct.str().size() << "\n";
+
+    str huge(ui_stream::magic, sizeof(ui_stream::magic));
+    huge += char(ui_stream::version);
+    huge += char(ui_stream::op_str);
+    put_varint(huge, 1ll << 40);
+    ostringstream ignored;
+    ui_cmd i(ignored);
+    if (replay_bytes(huge, i)) {
+        cout << "  a string of 2^40 bytes is accepted\n";
+        same = false;
+    }
+    return same;
+}
+
+struct check
+{
+    const char *name;
+    bool (*run)();
+};
+
+const check checks[] = {
+    { "bulk", check_bulk },
+    { "skip_debt", check_skip_debt },
+    { "catch_up_debt", check_catch_up_debt },
+    { "estimate", check_estimate },
+    { "stream", check_stream },
+    { "fork", check_fork },
+};
+
+}
+
+int main(int argc, char **argv)
+{
+    int failed = 0;
+    for (const check &c : checks) {
+        bool wanted = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            wanted = wanted || !strcmp(argv[i], c.name);
+        if (!wanted)
+            continue;
+        const bool ok = c.run();
+        cout << c.name << ": " << (ok ? "ok" : "FAILED") << "\n";
+        failed += !ok;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,1687 @@
+#include <core.h>
+#include <estimate.h>
+#include <snapshot.h>
+
+#include <cassert>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+namespace ca {
+
+namespace {
+
+int lowest_bit(unsigned m)
+{
+    assert(m);
+#if defined(__GNUC__)
+    return __builtin_ctz(m);
+#else
+    int i = 0;
+    while (!(m & 1u)) {
+        m >>= 1;
+        ++i;
+    }
+    return i;
+#endif
+}
+
+int highest_bit(unsigned m)
+{
+    assert(m);
+#if defined(__GNUC__)
+    return 31 - __builtin_clz(m);
+#else
+    int i = 0;
+    while (m >>= 1)
+        ++i;
+    return i;
+#endif
+}
+
+}
+
+int dice_pool::total() const
+{
+    int sum = 0;
+    for (int c : count_)
+        sum += c;
+    return sum;
+}
+
+bool dice_pool::inc(dice_hash dh, int added)
+{
+    const int i = index(dh);
+    int &stored = count_[i];
+    if (added < 0 && -added > stored)
+        return false;
+
+    stored += added;
+    if (stored)
+        mask_ |= 1u << i;
+    else
+        mask_ &= ~(1u << i);
+    return true;
+}
+
+void dice_pool::inc(const int (&added)[faces])
+{
+    for (int i = 0; i < faces; ++i) {
+        assert(added[i] >= 0);
+        count_[i] += added[i];
+        if (count_[i])
+            mask_ |= 1u << i;
+    }
+}
+
+dice_hash dice_pool::lowest(int min_value) const
+{
+    if (min_value < 1)
+        min_value = 1;
+    if (min_value > faces)
+        return dh_invalid;
+    const unsigned m = mask_ & (~0u << (min_value - 1));
+    return m ? hash(lowest_bit(m)) : dh_invalid;
+}
+
+dice_hash dice_pool::highest(int max_value) const
+{
+    if (max_value < 1)
+        return dh_invalid;
+    if (max_value > faces)
+        max_value = faces;
+    const unsigned m = mask_ & ((1u << max_value) - 1);
+    return m ? hash(highest_bit(m)) : dh_invalid;
+}
+
+herbalist::herbalist()
+{
+    static constexpr upgrade_curve activates_curve(
+            1, linear_growing_number(1),
+            200, multiply_growing_number(1.5),
+            8, "Number of activations");
+    add_upgrade(activates, activates_curve);
+}
+
+bool herbalist::activate_(state &s, int)
+{
+    s.inc_dice(s.roll_d6(), 1);
+    return true;
+}
+
+int herbalist::activate_bulk_(state &s, int, int left)
+{
+    assert(left > 0);
+    int rolled[dice_pool::faces] = {};
+    s.roll_d6s(left, rolled);
+    s.inc_dice(rolled);
+    return left;
+}
+
+int herbalist::activate_run_(state &s, const shared<room> *run, int *done, int count, bool &activated)
+{
+    int rolls = 0;
+    for (int i = 0; i < count; ++i) {
+        const herbalist &h = static_cast<const herbalist &>(*run[i]);
+        assert(h.type() == type_id);
+        assert(done[i] <= h.activates_max_());
+        rolls += max(0, h.activates_max_() - done[i]);
+        done[i] = h.activates_max_();
+    }
+    // the dice are rolled in the same order, only added to the pool at once
+    int rolled[dice_pool::faces] = {};
+    s.roll_d6s(rolls, rolled);
+    s.inc_dice(rolled);
+    activated = activated || rolls > 0;
+    return count;
+}
+
+int herbalist::activates_max_() const
+{
+    return upgrade_value_floor(activates);
+}
+
+void herbalist::draw_info(ui &o, int) const
+{
+    o << "generates a D6";
+}
+
+room_arena::~room_arena()
+{
+    // every chunk starts with a pointer to the one cut before it
+    while (chunks_) {
+        char *prev = *reinterpret_cast<char **>(chunks_);
+        ::operator delete(chunks_);
+        chunks_ = prev;
+    }
+}
+
+void *room_arena::allocate(size_t size, size_t align)
+{
+    const size_t c = (size + block - 1) / block;
+    if (c >= classes || align > block)
+        return ::operator new(size);
+    lock_guard<mutex> lock(m_);
+    void *p = free_[c];
+    if (p) {
+        free_[c] = free_[c]->next;
+    } else {
+        if (end_ - next_ < ptrdiff_t(c * block)) {
+            char *fresh = static_cast<char *>(::operator new(chunk));
+            *reinterpret_cast<char **>(fresh) = chunks_;
+            chunks_ = fresh;
+            next_ = fresh + block;
+            end_ = fresh + chunk;
+        }
+        p = next_;
+        next_ += c * block;
+    }
+    return p;
+}
+
+void room_arena::deallocate(void *p, size_t size, size_t align)
+{
+    const size_t c = (size + block - 1) / block;
+    if (c >= classes || align > block) {
+        ::operator delete(p);
+        return;
+    }
+    lock_guard<mutex> lock(m_);
+    free_[c] = new (p) free_block{ free_[c] };
+}
+
+state::state() : state(std::make_shared<room_arena>())
+{
+}
+
+state::state(shared<room_arena> arena) : arena_(move(arena)), layout_(std::allocate_shared<layout>(allocator()))
+{
+    layout_->shop = {
+        make_room<herbalist>(),
+        make_room<splitter>(),
+        make_room<seller>(),
+        make_room<mass_seller>(),
+        make_room<panacea>(),
+    };
+
+    insert_room(0, make_room<herbalist>());
+    insert_room(1, make_room<herbalist>());
+    insert_room(2, make_room<herbalist>());
+    insert_room(3, make_room<herbalist>());
+    insert_room(4, make_room<seller>());
+}
+
+void state::seed(unsigned s, unsigned stream)
+{
+    rng_.seed(s, stream);
+}
+
+dice_hash state::roll_d6()
+{
+    std::uniform_int_distribution<int> roll(dh_d6_first, dh_d6_last);
+    return dice_hash(roll(rng_));
+}
+
+void state::roll_d6s(int count, int (&rolled)[dice_pool::faces])
+{
+    assert(count >= 0);
+    if (count <= 0)
+        return;
+    const int faces = dice_pool::faces;
+    // a few dice are not worth the bits thrown away
+    if (dice_mode_ == dice_exact || count < 4) {
+        while (count--)
+            rolled[dice_pool::index(roll_d6())]++;
+        return;
+    }
+    if (count >= 1024) {
+        // the multinomial face counts as a chain of binomials over the dice left
+        for (int i = 0; i < faces - 1 && count; ++i) {
+            std::binomial_distribution<int> face(count, 1.0 / (faces - i));
+            const int n = face(rng_);
+            rolled[i] += n;
+            count -= n;
+        }
+        rolled[faces - 1] += count;
+        return;
+    }
+    // a number below 6^12 drawn from 32 random bits is 12 dice in its base 6 digits
+    const uint32_t below = 2176782336u;
+    while (count) {
+        uint32_t bits = uint32_t(rng_());
+        if (bits >= below)
+            continue;
+        for (int d = 0; d < 12 && count; ++d, --count) {
+            rolled[bits % faces]++;
+            bits /= faces;
+        }
+    }
+}
+
+bool state::inc_dice(dice_hash dh, int added)
+{
+    assert(added);
+    return dice_.inc(dh, added);
+}
+
+bool state::inc_gold(int added)
+{
+    if (added < 0 && -added > gold_)
+        return false;
+
+    gold_ += added;
+    return true;
+}
+
+dice_hash state::has_dice(dice::filter f, int count, dice::comparer c) const
+{
+    assert(count >= 1);
+    assert(f);
+    dice_hash best = dh_invalid;
+    for (unsigned m = dice_.mask(); m; m &= m - 1) {
+        const dice_hash dh = dice_pool::hash(lowest_bit(m));
+        if (dice_.count(dh) < count)
+            continue;
+        if (!f(dh))
+            continue;
+        if (!c)
+            return dh;
+        if (best == dh_invalid || c(dh, best))
+            best = dh;
+    }
+    return best;
+}
+
+void state::insert_room(int pos, shared<room> r)
+{
+    assert(r);
+    track_debt_(*r, 1);
+    list<shared<room>> &rooms = mut_layout_().rooms;
+    rooms.insert(rooms.begin() + pos, move(r));
+    index_rooms_();
+}
+
+state state::fork() const
+{
+    state f = *this;
+    f.ui_ = nullptr;
+    f.frames_ = nullptr;
+    f.recorded_ = nullptr;
+    f.profile_ = nullptr;
+    f.estimator_ = nullptr;
+    return f;
+}
+
+state::layout &state::mut_layout_()
+{
+    if (layout_.use_count() > 1)
+        layout_ = std::allocate_shared<layout>(allocator(), *layout_);
+    return *layout_;
+}
+
+room &state::mut_room_(int r)
+{
+    shared<room> &p = mut_layout_().rooms[r];
+    if (p.use_count() > 1)
+        p = p->clone(allocator());
+    return *p;
+}
+
+const shared<room> &state::activating_(int r)
+{
+    const shared<room> &p = layout_->rooms[r];
+    // the profile counts into the room, so a profiled room changes on every activation
+    if (p->changes_on_activate() || (profiling && profile_ && profile_->enabled))
+        mut_room_(r);
+    return layout_->rooms[r];
+}
+
+void state::index_rooms_()
+{
+    layout &l = mut_layout_();
+    for (vector<int> &positions : l.by_type)
+        positions.clear();
+    for (int i = 0; i < int(l.rooms.size()); ++i)
+        l.by_type[l.rooms[i]->type()].push_back(i);
+}
+
+void state::track_debt_(const room &r, int sign)
+{
+    if (r.type() != rt_debt_collector)
+        return;
+    const int waits = static_cast<const debt_collector &>(r).waits_gold();
+    if (!waits)
+        return;
+    debts_.count += sign;
+    debts_.gold += sign * waits;
+    assert(debts_.count >= 0 && debts_.gold >= 0);
+}
+
+seller::seller()
+{
+    static constexpr upgrade_curve money_mult_curve(
+            1, linear_growing_number(0.1),
+            100, multiply_growing_number(1.5),
+            10, "Gold output multiplier");
+    add_upgrade(money_mult, money_mult_curve);
+}
+
+bool seller::activate_(state &s, int)
+{
+    const dice_hash dh = s.find_dice(dice_query::any{});
+    if (!dh)
+        return false;
+
+    s.inc_dice(dh, -1);
+    s.inc_gold(upgrade_value_multiplier(money_mult, dice(dh).value()));
+    return true;
+}
+
+int seller::activate_bulk_(state &s, int, int left)
+{
+    int sold = 0;
+    while (left == -1 || sold < left) {
+        const dice_hash dh = s.find_dice(dice_query::any{});
+        if (!dh)
+            break;
+        int count = s.pool().count(dh);
+        if (left != -1)
+            count = min(count, left - sold);
+        s.inc_dice(dh, -count);
+        s.inc_gold(count * upgrade_value_multiplier(money_mult, dice(dh).value()));
+        sold += count;
+    }
+    return sold;
+}
+
+void seller::model_(room_model &m) const
+{
+    for (int i = 0; i < dice_pool::faces; ++i)
+        m.gain[i] = upgrade_value_multiplier(money_mult, dice(dice_pool::hash(i)).value());
+}
+
+int seller::activates_max_() const
+{
+    return -1;
+}
+
+void seller::draw_info(ui &o, int) const
+{
+    o << "sells any dice for it's value in gold";
+}
+
+bool room::activate(state &s, int &done)
+{
+    if constexpr (profiling)
+        if (s.profile_ && s.profile_->enabled)
+            return profiled_(s, done, [&] { return activate_one_(s, done) ? 1 : 0; });
+    return activate_one_(s, done);
+}
+
+int room::activate_bulk(state &s, int &done, int budget)
+{
+    if constexpr (profiling)
+        if (s.profile_ && s.profile_->enabled)
+            return profiled_(s, done, [&] { return activate_bulk_budget_(s, done, budget); });
+    return activate_bulk_budget_(s, done, budget);
+}
+
+int room::activate_run(state &s, const shared<room> *run, int *done, int count, bool &activated)
+{
+    assert(count > 0 && run[0].get() == this);
+    // the profile counts every room on its own
+    if constexpr (profiling)
+        if (s.profile_ && s.profile_->enabled)
+            return room::activate_run_(s, run, done, count, activated);
+    return activate_run_(s, run, done, count, activated);
+}
+
+int room::activate_run_(state &s, const shared<room> *run, int *done, int count, bool &activated)
+{
+    for (int i = 0; i < count; ++i) {
+        if (run[i]->activate_bulk(s, done[i], -1))
+            activated = true;
+        if (!run[i]->exhausted(done[i]))
+            return i;
+    }
+    return count;
+}
+
+// kept out of line, so the unprofiled path stays as small as it was
+template<typename activate_t>
+[[gnu::noinline]] int room::profiled_(state &s, int done_before, activate_t act)
+{
+    const bool could = !exhausted(done_before);
+    const int gold = s.gold();
+    const int dice = s.pool().total();
+    const auto start = chrono::steady_clock::now();
+    const int done = act();
+    room_stats d;
+    d.ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    d.calls = 1;
+    d.activations = done;
+    d.failed = could && !done;
+    d.gold = s.gold() - gold;
+    d.dice = s.pool().total() - dice;
+    stats_.add(d);
+    s.profile_->types[type()].add(d);
+    return done;
+}
+
+bool room::activate_one_(state &s, int &done)
+{
+    if (exhausted(done))
+        return false;
+    if (!activate_(s, done))
+        return false;
+    done++;
+    return true;
+}
+
+int room::activate_bulk_budget_(state &s, int &done, int budget)
+{
+    int left = budget;
+    if (activates_max_() != -1) {
+        const int can = activates_max_() - done;
+        left = budget == -1 ? can : min(budget, can);
+    }
+    if (left != -1 && left <= 0)
+        return 0;
+    const int now = activate_bulk_(s, done, left);
+    assert(left == -1 || now <= left);
+    done += now;
+    return now;
+}
+
+shared<room> room::create(room_type t, const room_allocator<room> &a)
+{
+    switch (t) {
+    case rt_herbalist:
+        return std::allocate_shared<herbalist>(room_allocator<herbalist>(a));
+    case rt_seller:
+        return std::allocate_shared<seller>(room_allocator<seller>(a));
+    case rt_mass_seller:
+        return std::allocate_shared<mass_seller>(room_allocator<mass_seller>(a));
+    case rt_splitter:
+        return std::allocate_shared<splitter>(room_allocator<splitter>(a));
+    case rt_debt_collector:
+        return std::allocate_shared<debt_collector>(room_allocator<debt_collector>(a));
+    case rt_panacea:
+        return std::allocate_shared<panacea>(room_allocator<panacea>(a));
+    case rt_invalid:
+    case rt_count:
+        break;
+    }
+    return nullptr;
+}
+
+void room::save(snapshot_room &r) const
+{
+    r = snapshot_room{};
+    r.type = type();
+    r.activates = 0;
+    for (int u = 0; u < upgrade_count_; ++u)
+        r.levels[u] = upgrades_[u].level();
+    save_(r);
+}
+
+void room::model(room_model &m) const
+{
+    m = room_model{};
+    m.type = type();
+    m.left = activates_max_() == -1 ? -1 : activates_max_();
+    model_(m);
+}
+
+bool room::load(const snapshot_room &r)
+{
+    // snapshots are taken between rolls, when no room has activated yet
+    if (r.type != type() || r.activates != 0)
+        return false;
+    for (int u = 0; u < upgrade_count_; ++u)
+        if (!upgrades_[u].set_level(r.levels[u]))
+            return false;
+    return load_(r);
+}
+
+bool room::level_up_upgrade(int u, state &s)
+{
+    return 0 <= u && u < upgrade_count_ && upgrades_[u].level_up(s);
+}
+
+void room::draw(ui &o, int r, int activates) const
+{
+    o.begin_room();
+    {
+        o.begin_paragraph();
+        {
+            o << name() << ", " << level();
+            o << ": ";
+            draw_info(o, activates);
+
+            if (activates_max_() != -1) {
+                const int left = activates_max_() - activates;
+                o << " (";
+                switch(left) {
+                case 0:
+                    o << "no activations";
+                    break;
+                case 1:
+                    o << "1 activation";
+                    break;
+                default:
+                    o << left << " activations";
+                    break;
+                }
+                o << " left)";
+            }
+        }
+        o.nl();
+        if (price() >= 0) {
+            o.begin_button(ui::mk_room_action(r, ui::room_action_sell));
+            o << "Sell for " << (price() * level()) << ui::gold;
+            o.end_button();
+        }
+        {
+            // TODO: add duplicate (for full price)
+
+            o.begin_button(ui::mk_room_action(r, ui::room_action_move_up));
+            o << "Move up";
+            o.end_button();
+            o.begin_button(ui::mk_room_action(r, ui::room_action_move_down));
+            o << "Move down";
+            o.end_button();
+        }
+        o.end_paragraph();
+        o.begin_list();
+        for (int u = 0; u < upgrade_count_; ++u)
+            upgrades_[u].draw(o, ui::mk_signal(r, u));
+        o.end_list();
+    }
+    o.end_room();
+}
+
+int room::level() const
+{
+    int lvl = 1;
+    for (int u = 0; u < upgrade_count_; ++u)
+        lvl += upgrades_[u].level();
+    return lvl;
+}
+
+void room::add_upgrade(int i, const upgrade_curve &c)
+{
+    assert(i == upgrade_count_ && i < max_upgrades);
+    upgrades_[upgrade_count_++] = upgrade(c);
+}
+
+void state::next_roll()
+{
+    if (state_ != gaming)
+        return;
+
+    while (activate_next()) {}
+    activates_.clear();
+
+    rolls++;
+    switch (rolls) {
+    case 100:
+        insert_room(room_count(), make_room<debt_collector>(2000));
+        break;
+    case 200:
+        insert_room(room_count(), make_room<debt_collector>(5000));
+        break;
+    case 300:
+        insert_room(room_count(), make_room<debt_collector>(10000));
+        break;
+    default:
+        break;
+    }
+}
+
+bool state::activate_next()
+{
+    const int count = room_count();
+    // the first activation of a roll starts the counts, next_roll clears them
+    if (int(activates_.size()) != count)
+        activates_.assign(count, 0);
+    if (frames_) {
+        for (int i = 0; i < count; ++i) {
+            if (activating_(i)->activate(*this, activates_[i])) {
+                frames_->record(*this, i, 1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // a room that is still able to activate before the activating one may need
+    // a new dice in between, so then the room gets only one activation
+    bool awake_before = false;
+    bool activated = false;
+    for (int i = 0; i < count;) {
+        if (awake_before) {
+            if (activating_(i)->activate_bulk(*this, activates_[i], 1))
+                return true;
+            ++i;
+            continue;
+        }
+        // with every room before exhausted the rooms of a type standing in a row
+        // go in one pass, the same as scanning again after each of them
+        const room_type type = layout_->rooms[i]->type();
+        int run = 1;
+        while (i + run < count && layout_->rooms[i + run]->type() == type)
+            ++run;
+        for (int k = 0; k < run; ++k)
+            activating_(i + k);
+        const shared<room> *rooms = &layout_->rooms[i];
+        const int exhausted = rooms[0]->activate_run(*this, rooms, &activates_[i], run, activated);
+        if (exhausted < run) {
+            // the room left awake may be able to go on after a scan from the start
+            if (activated)
+                return true;
+            awake_before = true;
+            i += exhausted + 1;
+            continue;
+        }
+        i += run;
+    }
+    return activated;
+}
+
+skip_summary state::skip(const skip_until &until)
+{
+    skip_summary sum;
+    const int gold = gold_;
+    frame_scheduler *frames = frames_;
+    frames_ = nullptr;
+    while (true) {
+        if (state_ != gaming) {
+            sum.stopped = skip_summary::game_over;
+            break;
+        }
+        if (until.gold != -1 && gold_ >= until.gold) {
+            sum.stopped = skip_summary::gold_reached;
+            break;
+        }
+        if (sum.rolls >= until.rolls) {
+            sum.stopped = skip_summary::rolls_done;
+            break;
+        }
+        // a collector may arrive in the roll another one is paid off, so the debts
+        // may not change while collectors do
+        const int collectors = count_of(rt_debt_collector);
+        next_roll();
+        sum.rolls++;
+        if (until.debt && count_of(rt_debt_collector) > collectors) {
+            sum.stopped = skip_summary::debt_arrived;
+            break;
+        }
+    }
+    frames_ = frames;
+    sum.gold = gold_ - gold;
+    return sum;
+}
+
+catch_up_summary state::catch_up(double elapsed, const catch_up_options &opt)
+{
+    assert(opt.seconds_per_roll > 0);
+    using clock = std::chrono::steady_clock;
+    const auto start = clock::now();
+    const int batch = 1000;
+    const int gold = gold_;
+    catch_up_summary sum;
+    sum.due = elapsed > 0 ? (long long)(elapsed / opt.seconds_per_roll) : 0;
+    while (sum.rolls < sum.due) {
+        skip_until until;
+        until.rolls = int(min<long long>(batch, sum.due - sum.rolls));
+        const skip_summary s = skip(until);
+        sum.rolls += s.rolls;
+        sum.ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        if (s.stopped == skip_summary::debt_arrived || s.stopped == skip_summary::game_over) {
+            sum.stopped = s.stopped;
+            break;
+        }
+        if (opt.progress && !opt.progress(sum.rolls, sum.due))
+            break;
+        if (sum.ms >= opt.budget_ms)
+            break;
+    }
+    sum.gold = gold_ - gold;
+    skipped_.stopped = sum.stopped == skip_summary::none && sum.rolls ? skip_summary::rolls_done : sum.stopped;
+    skipped_.rolls = int(sum.rolls);
+    skipped_.gold = sum.gold;
+    return sum;
+}
+
+void state::reset()
+{
+    auto rng = rng_;
+    auto *ui = ui_;
+    auto *frames = frames_;
+    auto *recorded = recorded_;
+    auto *profile = profile_;
+    auto *estimator = estimator_;
+    const auto mode = dice_mode_;
+    // the arena and the blocks freed by the last game are kept for the next one
+    *this = state(arena_);
+    dice_mode_ = mode;
+    swap(rng, rng_);
+    swap(ui, ui_);
+    swap(frames, frames_);
+    swap(recorded, recorded_);
+    swap(profile, profile_);
+    swap(estimator, estimator_);
+}
+
+void state::draw(ui &o) const
+{
+    draw_(o, nullptr, nullptr);
+}
+
+void state::draw(ui &o, const frame_step &step, const vector<int> &activates) const
+{
+    draw_(o, &step, &activates);
+}
+
+void room_stats::add(const room_stats &d)
+{
+    calls += d.calls;
+    activations += d.activations;
+    failed += d.failed;
+    gold += d.gold;
+    dice += d.dice;
+    ns += d.ns;
+}
+
+void room_profile::clear()
+{
+    for (room_stats &st : types)
+        st = room_stats{};
+}
+
+namespace {
+
+// the name the rooms of a type show
+const char *type_name(room_type t)
+{
+    static const auto names = [] {
+        vector<str> n(rt_count);
+        const room_allocator<room> a(std::make_shared<room_arena>());
+        for (int i = 0; i < rt_count; ++i)
+            n[i] = room::create(room_type(i), a)->name();
+        return n;
+    }();
+    return names.at(t).c_str();
+}
+
+void write_stats(out &o, const room_stats &st)
+{
+    o << st.calls << ',' << st.activations << ',' << st.failed << ','
+      << st.gold << ',' << st.dice << ',' << st.ns << '\n';
+}
+
+void draw_stats(ui &o, const room_stats &st)
+{
+    o << int(st.activations) << " activations in " << int(st.calls) << " calls";
+    if (st.failed)
+        o << ", " << int(st.failed) << " failed";
+    if (st.gold)
+        o << ", " << (st.gold > 0 ? "+" : "") << int(st.gold) << ui::gold;
+    if (st.dice)
+        o << ", " << (st.dice > 0 ? "+" : "") << int(st.dice) << " dice";
+    o << ", " << int(st.ns / 1000) << " us";
+}
+
+}
+
+void room_profile::write_csv(out &o, const state &s) const
+{
+    o << "scope,index,name,calls,activations,failed,gold,dice,ns\n";
+    for (int t = 0; t < rt_count; ++t) {
+        o << "type," << t << ',' << type_name(room_type(t)) << ',';
+        write_stats(o, types[t]);
+    }
+    for (int r = 0; r < s.room_count(); ++r) {
+        o << "room," << r << ',' << s.room_at(r).name() << ',';
+        write_stats(o, s.room_at(r).stats_);
+    }
+}
+
+void state::draw_(ui &o, const frame_step *step, const vector<int> *activates) const
+{
+    const dice_pool &pool = step ? step->pool : dice_;
+    o.begin_section(ui::section_header);
+    if (state_ != gaming) {
+        o.begin_paragraph();
+        switch (state_) {
+        case lost_by_debt:
+            o << "Game Over: lost by multiple debts at once";
+            break;
+        case won_by_panacea:
+            o << "Game Over: won by Panacea";
+            break;
+        default:
+            break;
+        }
+        o.begin_button(ui::restart);
+        o << "Restart";
+        o.end_button();
+        o.end_paragraph();
+    }
+    o.begin_paragraph();
+    o << "Gold: " << (step ? step->gold : gold()) << ui::gold;
+    o << " Rolls: " << (step ? step->roll : rolls);
+    if (debts_.count)
+        o << " Debt: " << debts_.gold << ui::gold;
+    if (debts_.count > 1)
+        o << " to " << debts_.count << " collectors";
+    {
+        o << " ";
+        o.begin_button(ui::next_roll);
+        o << "Next roll";
+        o.end_button();
+        o << " ";
+        o.begin_button(ui::next_roll_10);
+        o << "x10";
+        o.end_button();
+        o << " ";
+        o.begin_button(ui::next_roll_100);
+        o << "x100";
+        o.end_button();
+        o << " ";
+        o.begin_button(ui::skip_rolls);
+        o << "Skip";
+        o.end_button();
+        o.begin_button(ui::restart);
+        o << "Restart";
+        o.end_button();
+        if (profiling && profile_) {
+            o << " ";
+            o.begin_button(ui::toggle_profile);
+            o << (profile_->enabled ? "Hide profile" : "Profile");
+            o.end_button();
+        }
+    }
+    o.end_paragraph();
+    if (skipped_.rolls) {
+        o.begin_paragraph();
+        o << "Skipped " << skipped_.rolls << " rolls, " << (skipped_.gold >= 0 ? "+" : "")
+          << skipped_.gold << ui::gold;
+        switch (skipped_.stopped) {
+        case skip_summary::gold_reached:
+            o << ", gold reached";
+            break;
+        case skip_summary::debt_arrived:
+            o << ", a debt collector came";
+            break;
+        case skip_summary::game_over:
+            o << ", the game is over";
+            break;
+        default:
+            break;
+        }
+        o.end_paragraph();
+    }
+    o.end_section();
+
+    o.begin_section(ui::section_pool);
+    o.begin_paragraph();
+    o << "Dice pool: ";
+    for (int i = 0; i < dice_pool::faces; ++i) {
+        const dice_hash dh = dice_pool::hash(i);
+        int count = pool.count(dh);
+        while (count--) {
+            switch (dice(dh).type()) {
+            case dt_d6:
+                o << ui::symbol(ui::d6_first + dice(dh).value() - 1);
+                break;
+            default:
+                o << ui::undefined;
+                break;
+            }
+        }
+    }
+    o.end_paragraph();
+    if (estimator_ && state_ == gaming) {
+        const income_estimate &e = estimator_->get(*this);
+        o.begin_paragraph();
+        o << "Next roll: " << (e.gold >= 0 ? "+" : "") << int(lround(e.gold)) << ui::gold
+          << " (sd " << int(lround(sqrt(e.gold_var))) << ")"
+          << ", dice " << (e.dice >= 0 ? "+" : "") << int(lround(e.dice))
+          << " (sd " << int(lround(sqrt(e.dice_var))) << ")";
+        if (e.lost > 0)
+            o << ", lost by debt " << int(lround(100 * e.lost)) << "%";
+        if (e.won > 0)
+            o << ", won " << int(lround(100 * e.won)) << "%";
+        if (e.dropped > 0)
+            o << " (approximate)";
+        o.end_paragraph();
+    }
+    o.end_section();
+
+    o.begin_section(ui::section_rooms);
+    o << "Rooms: ";
+    o.end_section();
+    const list<shared<room>> &rooms = layout_->rooms;
+    for (int i = 0; i < int(rooms.size()); ++i) {
+        o.begin_section(ui::section_room, i);
+        o.begin_list();
+        if (activates && i < int(activates->size()))
+            rooms[i]->draw(o, i, (*activates)[i]);
+        else
+            rooms[i]->draw(o, i);
+        o.end_list();
+        o.end_section();
+    }
+
+    o.begin_section(ui::section_shop);
+    o << "Buy new: ";
+    o.begin_list();
+    const list<shared<room>> &shop = layout_->shop;
+    for (int i = 0; i < int(shop.size()); ++i) {
+        o.begin_room();
+        o << shop[i]->name() << ", " << shop[i]->level() << ": ";
+        shop[i]->draw_info(o, 0);
+        o << " ";
+        o.begin_button(ui::mk_room_buy(i));
+        o << "Buy for " << shop[i]->price() << ui::gold;
+        o.end_button();
+        o.end_room();
+    }
+    o.end_list();
+    o.end_section();
+
+    if (profiling && profile_ && profile_->enabled) {
+        o.begin_section(ui::section_profile);
+        o << "Profile: ";
+        o.begin_list();
+        for (int t = 0; t < rt_count; ++t) {
+            const room_stats &st = profile_->types[t];
+            if (!st.calls)
+                continue;
+            o.begin_room();
+            o << "all " << type_name(room_type(t)) << ": ";
+            draw_stats(o, st);
+            o.end_room();
+        }
+        for (int i = 0; i < int(rooms.size()); ++i) {
+            o.begin_room();
+            o << (i + 1) << ". " << rooms[i]->name() << ": ";
+            draw_stats(o, rooms[i]->stats_);
+            o.end_room();
+        }
+        o.end_list();
+        o.end_section();
+    }
+    o.flush();
+}
+
+bool state::btn(ui::signal s)
+{
+    struct update_on_exit
+    {
+        ~update_on_exit()
+        {
+            if (!ui_)
+                return;
+            if (s_->frames_)
+                s_->frames_->replay(*s_, *ui_);
+            s_->draw(*ui_);
+        }
+        state *s_ = nullptr;
+        ui *ui_ = nullptr;
+    } exit { this, ui_ };
+
+    if (frames_)
+        frames_->clear();
+    if (recorded_)
+        recorded_->push_back(s);
+    skipped_ = skip_summary{};
+
+    if (s == ui::restart) {
+        reset();
+        return true;
+    }
+    if (s == ui::toggle_profile) {
+        if (!profiling || !profile_)
+            return false;
+        profile_->enabled = !profile_->enabled;
+        return true;
+    }
+    if (s == ui::next_roll) {
+        next_roll();
+        return true;
+    }
+    if (s == ui::next_roll_10) {
+        next_roll();
+        int count = 9;
+        while (count-- && rolls % 100)
+            next_roll();
+        return true;
+    }
+    if (s == ui::skip_rolls) {
+        if (state_ != gaming)
+            return false;
+        skipped_ = skip(skip_until{});
+        return true;
+    }
+    if (s == ui::next_roll_100) {
+        next_roll();
+        int count = 99;
+        while (count-- && rolls % 100)
+            next_roll();
+        return true;
+    }
+    int r, u;
+    if (ui::rd_room_upgrade(s, r, u)) {
+        if (r >= room_count())
+            return false;
+        return layout_->rooms[r] && mut_room_(r).level_up_upgrade(u, *this);
+    }
+    if (ui::rd_room_action(s, r, u)) {
+        bool ok = false;
+        switch (u) {
+        case ui::room_action_sell:
+            ok = sell_room(r);
+            break;
+        case ui::room_action_move_up:
+            ok = move_room(r, -1);
+            break;
+        case ui::room_action_move_down:
+            ok = move_room(r, +1);
+            break;
+        default:
+            assert(false && "unreachable");
+            break;
+        }
+        return ok;
+    }
+    if (ui::rd_room_buy(s, u))
+        return buy_room(u);
+
+    return false;
+}
+
+bool state::move_room(int r, int mod)
+{
+    while (mod > 1) {
+        if (!move_room(r++, 1))
+            return false;
+        mod--;
+    }
+    while (mod < -1) {
+        if (!move_room(r--, -1))
+            return false;
+        mod++;
+    }
+    assert(-1 <= mod && mod <= 1);
+    if (!mod)
+        return true;
+
+    if (r < 0 || r >= room_count() || r + mod >= room_count() || r + mod < 0)
+        return false;
+    list<shared<room>> &rooms = mut_layout_().rooms;
+    swap(rooms[r], rooms[r + mod]);
+    index_rooms_();
+    return true;
+}
+
+bool state::sell_room(int r)
+{
+    if (r < 0 || r >= room_count())
+        return false;
+    // a collector is got rid of by paying all the debt it waits for at once, and
+    // is kept if the gold is short; any other room is sold for its price per level
+    const room &selling = room_at(r);
+    const int gold = selling.type() == rt_debt_collector
+            ? -static_cast<const debt_collector &>(selling).waits_gold()
+            : selling.price() * selling.level();
+    if (!inc_gold(gold))
+        return false;
+    track_debt_(selling, -1);
+    list<shared<room>> &rooms = mut_layout_().rooms;
+    rooms.erase(rooms.begin() + r);
+    index_rooms_();
+    return true;
+}
+
+bool state::buy_room(int u)
+{
+    if (u < 0 || u >= shop_count())
+        return false;
+
+    const room &buying = shop_at(u);
+    if (!inc_gold(-buying.price()))
+        return false;
+
+    // place the room after the rooms of the same type (or in the end if there are none)
+    const vector<int> &same = rooms_of(buying.type());
+    insert_room(same.empty() ? room_count() : same.back() + 1, buying.duplicate(allocator()));
+    return true;
+}
+
+void frame_scheduler::record(const state &s, int room, int count)
+{
+    frame_step step;
+    step.roll = s.rolls;
+    step.room = room;
+    step.count = count;
+    step.gold = s.gold();
+    step.pool = s.pool();
+    steps_.push_back(step);
+}
+
+void frame_scheduler::replay(const state &s, ui &o) const
+{
+    vector<int> activates;
+    int time = 0;
+    int shown = 0;
+    for (size_t i = 0; i < steps_.size(); ++i) {
+        const frame_step &step = steps_[i];
+        if (!i || steps_[i - 1].roll != step.roll)
+            activates.assign(s.room_count(), 0);
+        if (step.room < int(activates.size()))
+            activates[step.room] += step.count;
+
+        time += step_ms;
+        const bool roll_end = i + 1 == steps_.size() || steps_[i + 1].roll != step.roll;
+        if (rolls_only ? !roll_end : time - shown < frame_ms)
+            continue;
+        s.draw(o, step, activates);
+        shown = time;
+    }
+}
+
+bool upgrade::level_up(state &s)
+{
+    if (level_ >= level_max())
+        return false;
+    if (!s.inc_gold(-price()))
+        return false;
+    level_++;
+    return true;
+}
+
+bool upgrade::set_level(int lvl)
+{
+    if (lvl < level_ || lvl > level_max())
+        return false;
+    level_ = lvl;
+    return true;
+}
+
+void upgrade::draw(ui &o, ui::signal s) const
+{
+    o.begin_upgrade();
+    o << curve_->description << " (Lvl " << level_ << "/" << level_max() << "): ";
+    if (level_ < level_max())
+        o << value() << " -> " << curve_->value[level_ + 1];
+    else
+        o << value() << " (MAX)";
+
+    if (level_ < level_max()) {
+        o << " ";
+        o.begin_button(s);
+        o << "Upgrade for " << price() << ui::gold;
+        o.end_button();
+    }
+    o.end_upgrade();
+}
+
+ui &ui_cmd::operator <<(int i)
+{
+    o << i;
+    return *this;
+}
+
+ui &ui_cmd::operator <<(double d)
+{
+    o << d;
+    return *this;
+}
+
+ui &ui_cmd::operator <<(const str &s)
+{
+    o << s;
+    return *this;
+}
+
+ui &ui_cmd::operator <<(const char *s)
+{
+    o << s;
+    return *this;
+}
+
+ui &ui_cmd::operator <<(symbol s)
+{
+    if (s == gold)
+        o << "$";
+    else if (d6_first <= s && s <= d6_last)
+        o << "[" << (s - d6_first + 1) << "]";
+    else
+        o << "[?]";
+    return *this;
+}
+
+void ui_cmd::begin_room()
+{
+    push_scope(scope_room);
+    o << "<li>";
+}
+
+void ui_cmd::end_room()
+{
+    o << "</li>";
+    pop_scope(scope_room);
+}
+
+void ui_cmd::begin_upgrade()
+{
+    push_scope(scope_upgrade);
+    o << "<li>";
+}
+
+void ui_cmd::end_upgrade()
+{
+    o << "</li>";
+    pop_scope(scope_upgrade);
+}
+
+void ui_cmd::begin_button(signal s)
+{
+    push_scope(scope_btn);
+    o << "<a href=\"" << s << "\">[";
+}
+
+void ui_cmd::end_button()
+{
+    o << "]</a>";
+    pop_scope(scope_btn);
+}
+
+void ui_cmd::begin_paragraph()
+{
+    push_scope(scope_p);
+}
+
+void ui_cmd::end_paragraph()
+{
+    pop_scope(scope_p);
+}
+
+void ui_cmd::begin_list()
+{
+    push_scope(scope_ul);
+}
+
+void ui_cmd::end_list()
+{
+    pop_scope(scope_ul);
+}
+
+const char *ui_cmd::scope_str(scope s)
+{
+    switch (s) {
+    case scope_room:
+        return "room";
+    case scope_upgrade:
+        return "upgrade";
+    case scope_btn:
+        return "btn";
+    case scope_p:
+        return "p";
+    case scope_ul:
+        return "ul";
+    default:
+        break;
+    }
+    assert(false && "unreachable");
+    return "???";
+}
+
+void ui_cmd::push_scope(scope s)
+{
+    o << "\n";
+    scopes_stack_.push_back(s);
+    for (size_t i = 0; i < scopes_stack_.size(); ++i)
+        o << "  ";
+    o << "<" << scope_str(s) << ">";
+}
+
+void ui_cmd::pop_scope(scope s)
+{
+    o << "\n";
+    for (size_t i = 0; i < scopes_stack_.size(); ++i)
+        o << "  ";
+    o << "</" << scope_str(s) << ">";
+    assert(scopes_stack_.size() && scopes_stack_.back() == s);
+    scopes_stack_.pop_back();
+}
+
+ui &ui_html::operator <<(int i)
+{
+    char b[16];
+    const auto r = to_chars(b, b + sizeof(b), i);
+    append(b, r.ptr - b);
+    return *this;
+}
+
+ui &ui_html::operator <<(double d)
+{
+    // same as the default ostream output (%g), but with no locale
+    char b[32];
+    const auto r = to_chars(b, b + sizeof(b), d, chars_format::general, 6);
+    append(b, r.ptr - b);
+    return *this;
+}
+
+ui &ui_html::operator <<(const char *s)
+{
+    append(s);
+    return *this;
+}
+
+ui &ui_html::operator <<(symbol s)
+{
+    if (s == gold) {
+        append("$");
+    } else if (d6_first <= s && s <= d6_last) {
+        const char b[] = { '[', char('1' + s - d6_first), ']' };
+        append(b, sizeof(b));
+    } else {
+        append("[?]");
+    }
+    return *this;
+}
+
+void ui_html::begin_button(signal s)
+{
+    open(scope_a, "<a href=\"");
+    *this << int(s);
+    append("\">[");
+}
+
+void ui_html::append(const char *s)
+{
+    append(s, strlen(s));
+}
+
+void ui_html::open(scope s, const char *tag)
+{
+    assert(depth_ < max_depth);
+    if (s != scope_a)
+        indent();
+    scopes_[depth_++] = s;
+    append(tag);
+}
+
+void ui_html::close(scope s, const char *tag)
+{
+    assert(depth_ > 0 && scopes_[depth_ - 1] == s);
+    depth_--;
+    append(tag);
+}
+
+void ui_html::indent()
+{
+    if (!indent_)
+        return;
+    append("\n");
+    for (int i = 0; i < depth_; ++i)
+        append("  ");
+}
+
+splitter::splitter()
+{
+    static constexpr upgrade_curve max_split_count_curve(
+            2, linear_growing_number(1),
+            100, multiply_growing_number(2),
+            4, "Max split dice count");
+    add_upgrade(max_split_count, max_split_count_curve);
+}
+
+bool splitter::activate_(state &s, int)
+{
+    // the biggest dice to split completely, or the smallest one to split partially
+    const int split_count = upgrade_value_floor(max_split_count);
+    dice_hash dh = s.find_dice(dice_query::max_value{split_count, 3});
+    if (!dh)
+        dh = s.find_dice(dice_query::min_value{3});
+    if (!dh)
+        return false;
+
+    s.inc_dice(dh, -1);
+    s.inc_dice(dh_d6_first, min(split_count, dice(dh).value()));
+    return true;
+}
+
+void splitter::model_(room_model &m) const
+{
+    m.split = upgrade_value_floor(max_split_count);
+}
+
+void splitter::draw_info(ui &o, int) const
+{
+    o << "splits a D6 with 2+ into up to "
+      << upgrade_value_floor(max_split_count)
+      << " D6's with value 1";
+}
+
+mass_seller::mass_seller()
+{
+    static constexpr upgrade_curve activates_curve(
+            4, linear_growing_number(1),
+            10, multiply_growing_number(1.5),
+            5, "Number of activations");
+    add_upgrade(activates, activates_curve);
+    static constexpr upgrade_curve base_price_curve(
+            1, linear_growing_number(1),
+            100, multiply_growing_number(1.5),
+            5, "Base price");
+    add_upgrade(base_price, base_price_curve);
+}
+
+bool mass_seller::activate_(state &s, int done)
+{
+    const dice_hash dh = s.find_dice(dice_query::any{});
+    if (!dh)
+        return false;
+
+    s.inc_dice(dh, -1);
+    s.inc_gold(upgrade_value_multiplier(base_price) + done);
+    return true;
+}
+
+int mass_seller::activate_bulk_(state &s, int done, int left)
+{
+    assert(left > 0);
+    int sold = 0;
+    while (sold < left) {
+        const dice_hash dh = s.find_dice(dice_query::any{});
+        if (!dh)
+            break;
+        const int count = min(s.pool().count(dh), left - sold);
+        s.inc_dice(dh, -count);
+        sold += count;
+    }
+    // every activation costs 1 more: base + done, base + done + 1, ...
+    const int first = upgrade_value_multiplier(base_price) + done;
+    s.inc_gold(sold * first + sold * (sold - 1) / 2);
+    return sold;
+}
+
+void mass_seller::model_(room_model &m) const
+{
+    m.price = upgrade_value_multiplier(base_price);
+}
+
+int mass_seller::activates_max_() const
+{
+    return upgrade_value_floor(activates);
+}
+
+void mass_seller::draw_info(ui &o, int activates) const
+{
+    o << "sells a D6 for " << upgrade_value_multiplier(base_price);
+    if (activates)
+        o << " + *" << activates << "*";
+    o << " gold (each activation during roll increases cost by 1)";
+}
+
+ui::signal ui::mk_signal(int r, int u)
+{
+    assert(0 <= r && r < max_rooms);
+    assert(0 <= u && u < max_room_signals);
+    return signal((int)room_upgrade_first + max_room_signals * r + u);
+}
+
+ui::signal ui::mk_room_action(int r, int u)
+{
+    assert(0 <= u && u < max_room_actions);
+    return mk_signal(r, u + max_room_upgrades);
+}
+
+ui::signal ui::mk_room_upgrade(int r, int u)
+{
+    assert(0 <= u && u < max_room_upgrades);
+    return mk_signal(r, u);
+}
+
+ui::signal ui::mk_room_buy(int s)
+{
+    signal r = signal(room_buy_first + s);
+    assert(r <= room_buy_last);
+    return r;
+}
+
+bool ui::rd_signal(signal s, int &r, int &u)
+{
+    if (s < room_upgrade_first || s > room_upgrade_last)
+        return false;
+    const int ss = s - room_upgrade_first;
+    r = ss / max_room_signals;
+    u = ss % max_room_signals;
+    return true;
+}
+
+bool ui::rd_room_action(signal s, int &r, int &u)
+{
+    if (!rd_signal(s, r, u))
+        return false;
+    u -= max_room_upgrades;
+    if (0 <= u && u < max_room_actions)
+        return true;
+    return false;
+}
+
+bool ui::rd_room_upgrade(signal s, int &r, int &u)
+{
+    if (!rd_signal(s, r, u))
+        return false;
+    if (0 <= u && u < max_room_upgrades)
+        return true;
+    return false;
+}
+
+bool ui::rd_room_buy(signal s, int &b)
+{
+    if (s < room_buy_first || s > room_buy_last)
+        return false;
+    b = (s - room_buy_first);
+    return true;
+}
+
+debt_collector::debt_collector(int waits_gold) :
+    waits_gold_(waits_gold), waits_gold_total_(waits_gold)
+{
+    assert(waits_gold >= 0);
+    static constexpr upgrade_curve total_take_percent_curve(
+            0.05, linear_growing_number(-0.01),
+            50, multiply_growing_number(1.2),
+            4, "% of total debt taken per activation");
+    add_upgrade(total_take_percent, total_take_percent_curve);
+    static constexpr upgrade_curve bribed_curve(
+            1, linear_growing_number(-0.01),
+            100, multiply_growing_number(2),
+            10, "% of debt awaiting");
+    add_upgrade(bribed, bribed_curve);
+}
+
+bool debt_collector::activate_(state &s, int)
+{
+    if (!waits_gold_)
+        return false;
+
+    const bool have_multiple_debts_at_once = s.debts_.count > 1;
+    if (have_multiple_debts_at_once) {
+        s.state_ = state::lost_by_debt;
+        return true;
+    }
+
+    int can_take_per_time = upgrade_value_multiplier(total_take_percent, waits_gold_total_);
+    int can_take = min(s.gold(), min(waits_gold_, can_take_per_time));
+    if (!s.inc_gold(-upgrade_value_multiplier(bribed, can_take)))
+        return false;
+
+    waits_gold_ -= can_take;
+    s.debts_.gold -= can_take;
+    if (!waits_gold_)
+        s.debts_.count--;
+    return true;
+}
+
+void debt_collector::draw_info(ui &o, int) const
+{
+    if (waits_gold_) {
+        o << "came to collect debt " << waits_gold_ << ui::gold <<
+             " (of the total " << waits_gold_total_ << ui::gold << ")";
+        return;
+    }
+    o << "collected all the " << waits_gold_total_ << ui::gold << " debt, now chills";
+}
+
+void debt_collector::save_(snapshot_room &r) const
+{
+    r.waits_gold = waits_gold_;
+    r.waits_gold_total = waits_gold_total_;
+}
+
+bool debt_collector::load_(const snapshot_room &r)
+{
+    if (r.waits_gold < 0 || r.waits_gold > r.waits_gold_total)
+        return false;
+    waits_gold_ = r.waits_gold;
+    waits_gold_total_ = r.waits_gold_total;
+    return true;
+}
+
+void debt_collector::model_(room_model &m) const
+{
+    m.waits = waits_gold_;
+    m.take = upgrade_value_multiplier(total_take_percent, waits_gold_total_);
+    m.bribe = upgrade_value(bribed);
+}
+
+int debt_collector::price() const
+{
+    return waits_gold_ ? -1 : 0;
+}
+
+bool panacea::activate_(state &s, int)
+{
+    s.state_ = state::won_by_panacea;
+    return true;
+}
+
+void panacea::draw_info(ui &o, int) const
+{
+    o << "wins you the game!";
+}
+
+}
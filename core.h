@@ -0,0 +1,788 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <iostream>
+#include <sstream>
+
+#include <rng.h>
+
+// room activations are counted when a room_profile is attached to the state,
+// building with CA_PROFILE=0 leaves no trace of it in the hot path
+#ifndef CA_PROFILE
+#define CA_PROFILE 1
+#endif
+
+namespace ca {
+
+constexpr bool profiling = CA_PROFILE != 0;
+
+template<typename k, typename v> using map = std::map<k, v>;
+template<typename t> using vector = std::vector<t>;
+template<typename t> using list = std::vector<t>;
+template<typename t> using shared = std::shared_ptr<t>;
+using str = std::string;
+using out = std::ostream;
+using strout = std::stringstream;
+// the generator games roll with, small enough to be copied with the state
+using random_engine = philox;
+
+// memory for the rooms of a state and its forks: blocks are cut from big chunks by size,
+// freed blocks are kept and reused for the next rooms, and chunks go back to the heap
+// at once with the last user of the arena; forks in other threads may share it, a room
+// freed on any thread goes back to the free list of its arena under the mutex
+struct room_arena
+{
+    room_arena() = default;
+    room_arena(const room_arena &) = delete;
+    room_arena &operator=(const room_arena &) = delete;
+    ~room_arena();
+    void *allocate(size_t size, size_t align);
+    void deallocate(void *p, size_t size, size_t align);
+private:
+    enum { block = 16, classes = 32, chunk = 16384 };
+    struct free_block { free_block *next; };
+    std::mutex m_;
+    free_block *free_[classes] = {};
+    char *chunks_ = nullptr;
+    char *next_ = nullptr;
+    char *end_ = nullptr;
+};
+
+// allocates a room with its shared pointer control block in one block of an arena,
+// which lives as long as anything allocated from it
+template<typename t>
+struct room_allocator
+{
+    using value_type = t;
+    explicit room_allocator(shared<room_arena> a) : arena(std::move(a)) {}
+    template<typename u>
+    room_allocator(const room_allocator<u> &o) : arena(o.arena) {}
+    t *allocate(size_t n) { return static_cast<t *>(arena->allocate(n * sizeof(t), alignof(t))); }
+    void deallocate(t *p, size_t n) { arena->deallocate(p, n * sizeof(t), alignof(t)); }
+    template<typename u>
+    bool operator==(const room_allocator<u> &o) const { return arena == o.arena; }
+    template<typename u>
+    bool operator!=(const room_allocator<u> &o) const { return arena != o.arena; }
+    shared<room_arena> arena;
+};
+
+enum dice_type
+{
+    dt_invalid = 0,
+    dt_d6 = 1 << 4,
+};
+
+enum dice_hash
+{
+    dh_invalid = 0,
+    dh_d6 = dt_d6,
+    dh_d6_1,
+    dh_d6_2,
+    dh_d6_3,
+    dh_d6_4,
+    dh_d6_5,
+    dh_d6_6,
+    dh_d6_first = dh_d6_1,
+    dh_d6_last = dh_d6_6,
+};
+
+struct dice
+{
+    dice(dice_hash dh) : dh_(dh) { assert(dh != dh_invalid); }
+    dice_type type() const;
+    int value() const;
+
+    using filter = std::function<bool(dice)>;
+    using comparer = std::function<bool(dice, dice)>;
+    static bool filter_any(dice) { return true; }
+private:
+    dice_hash dh_ = dh_invalid;
+};
+
+// dice counts stored densely by face, with a bit per non-empty face
+struct dice_pool
+{
+    enum { faces = dh_d6_last - dh_d6_first + 1 };
+    int count(dice_hash dh) const { return count_[index(dh)]; }
+    int total() const;
+    bool inc(dice_hash, int added);
+    // adds a histogram of dice, count per face
+    void inc(const int (&added)[faces]);
+    unsigned mask() const { return mask_; }
+    bool empty() const { return !mask_; }
+    // lowest die with value >= min_value (dh_invalid if none)
+    dice_hash lowest(int min_value = 1) const;
+    // highest die with value <= max_value (dh_invalid if none)
+    dice_hash highest(int max_value = faces) const;
+    static int index(dice_hash dh) { assert(dh_d6_first <= dh && dh <= dh_d6_last); return dh - dh_d6_first; }
+    static dice_hash hash(int i) { return dice_hash(dh_d6_first + i); }
+private:
+    int count_[faces] = {};
+    unsigned mask_ = 0;
+};
+
+inline dice_type dice::type() const
+{
+    if (dh_d6_first <= dh_ && dh_ <= dh_d6_last)
+        return dt_d6;
+    return dt_invalid;
+}
+
+inline int dice::value() const
+{
+    switch (type()) {
+    case dt_d6:
+        return dh_ - dh_d6_first + 1;
+    case dt_invalid:
+        break;
+    }
+    return dh_invalid;
+}
+
+// ready-made queries for state::find_dice, each is a bit scan over the pool
+namespace dice_query {
+
+struct any
+{
+    dice_hash operator()(const dice_pool &p) const { return p.lowest(); }
+};
+
+// highest die with value in [from, to]
+struct max_value
+{
+    int to = dice_pool::faces;
+    int from = 1;
+    dice_hash operator()(const dice_pool &p) const
+    {
+        const dice_hash dh = p.highest(to);
+        return dh && dice(dh).value() >= from ? dh : dh_invalid;
+    }
+};
+
+// lowest die with value >= from
+struct min_value
+{
+    int from = 1;
+    dice_hash operator()(const dice_pool &p) const { return p.lowest(from); }
+};
+
+}
+
+struct room;
+struct room_model;
+struct snapshot;
+struct snapshot_room;
+struct income_estimator;
+
+enum room_type
+{
+    rt_invalid = -1,
+    rt_herbalist,
+    rt_seller,
+    rt_mass_seller,
+    rt_splitter,
+    rt_debt_collector,
+    rt_panacea,
+    rt_count,
+};
+
+struct ui
+{
+    enum symbol
+    {
+        undefined,
+        gold,
+        d6_first,
+        d6_last = d6_first + 5,
+    };
+    enum signal
+    {
+        next_roll = 10000,
+        next_roll_10,
+        next_roll_100,
+        restart,
+        toggle_profile,
+        skip_rolls,
+
+        room_upgrade_first = 20000,
+        max_rooms = 100,
+        max_room_actions = 900,
+        max_room_upgrades = 100,
+        max_room_signals = max_room_actions + max_room_upgrades,
+        room_upgrade_last  = room_upgrade_first + max_rooms * max_room_signals - 1,
+        room_action_sell = 1,
+        room_action_move_up,
+        room_action_move_down,
+
+        room_buy_first = 120000,
+        room_buy_last = 121000,
+    };
+    static signal mk_signal(int r, int u);
+    static signal mk_room_action(int r, int u);
+    static signal mk_room_upgrade(int r , int u);
+    static signal mk_room_buy(int s);
+    static bool rd_signal(signal, int &r, int &u);
+    static bool rd_room_action(signal, int &r, int &u);
+    static bool rd_room_upgrade(signal, int &r, int &u);
+    static bool rd_room_buy(signal, int &s);
+
+    virtual ~ui() = default;
+    virtual ui &operator<<(int) = 0;
+    virtual ui &operator<<(double) = 0;
+    virtual ui &operator<<(const str &) = 0;
+    virtual ui &operator<<(const char *s) { return *this << str(s); }
+    virtual ui &operator<<(symbol) = 0;
+    virtual void nl() {}
+    virtual void flush() {}
+
+    virtual void begin_room() {}
+    virtual void end_room() {}
+    virtual void begin_upgrade() {}
+    virtual void end_upgrade() {}
+    virtual void begin_button(signal) {}
+    virtual void end_button() {}
+    virtual void begin_paragraph() {}
+    virtual void end_paragraph() {}
+    virtual void begin_list() {}
+    virtual void end_list() {}
+
+    // independent parts of a frame, so a backend may update only the changed ones
+    enum section { section_header, section_pool, section_rooms, section_room, section_shop, section_profile };
+    virtual void begin_section(section, int = 0) {}
+    virtual void end_section() {}
+};
+
+struct state;
+
+// an activation of a room during a roll, recorded to be animated later
+struct frame_step
+{
+    int roll = 0;
+    int room = -1;
+    int count = 0;
+    int gold = 0;
+    dice_pool pool;
+};
+
+// records activation steps while rolls go and replays them into a ui afterwards,
+// so the game loop itself never renders
+struct frame_scheduler
+{
+    // every step takes step_ms of animation, but frames are rendered
+    // not more often than once per frame_ms of it (or once per roll)
+    int step_ms = 100;
+    int frame_ms = 33;
+    bool rolls_only = false;
+    int frame_delay_ms() const { return rolls_only ? frame_ms : std::max(step_ms, frame_ms); }
+
+    void record(const state &, int room, int count);
+    void replay(const state &, ui &) const;
+    void clear() { steps_.clear(); }
+    int steps() const { return int(steps_.size()); }
+private:
+    vector<frame_step> steps_;
+};
+
+// what room activations did, summed up per room and per room type
+struct room_stats
+{
+    long long calls = 0;
+    long long activations = 0;
+    // activate_ was called and did nothing
+    long long failed = 0;
+    long long gold = 0;
+    long long dice = 0;
+    long long ns = 0;
+    void add(const room_stats &);
+};
+
+struct room_profile
+{
+    // a switched off profile stays attached, but costs only a branch
+    bool enabled = true;
+    room_stats types[rt_count];
+    void clear();
+    // a row per room type, then a row per room of the state
+    void write_csv(out &, const state &) const;
+};
+
+// debts the collectors of a state still wait for, kept up to date as they come,
+// collect and get sold, so no room scan is needed to check them
+struct debt_registry
+{
+    int count = 0;
+    int gold = 0;
+};
+
+// when state::skip stops rolling, besides the end of the game
+struct skip_until
+{
+    // at most this many rolls
+    int rolls = 1000;
+    // once there is at least this much gold (-1 to ignore)
+    int gold = -1;
+    // right after a roll that brought a debt collector
+    bool debt = true;
+};
+
+struct skip_summary
+{
+    enum reason { none, rolls_done, gold_reached, debt_arrived, game_over };
+    reason stopped = none;
+    int rolls = 0;
+    int gold = 0;
+};
+
+// rolls for the time the game was closed, see state::catch_up
+struct catch_up_options
+{
+    // wall time a roll stands for while the game is closed
+    double seconds_per_roll = 10;
+    // the rolls left when this much wall time is spent on them are dropped
+    double budget_ms = 500;
+    // rolls are done in batches, progress is called after each one with the rolls done
+    // and the rolls due; returning false stops catching up
+    std::function<bool(long long done, long long due)> progress;
+};
+
+struct catch_up_summary
+{
+    // why the rolls stopped before they were all done: the game ended, a debt collector
+    // arrived, or none for the budget, a cancel or all rolls done (see rolls and due)
+    skip_summary::reason stopped = skip_summary::none;
+    long long due = 0;
+    long long rolls = 0;
+    int gold = 0;
+    double ms = 0;
+};
+
+struct state
+{
+    state();
+    ui *ui_ = nullptr;
+    frame_scheduler *frames_ = nullptr;
+    room_profile *profile_ = nullptr;
+    // shows the expected outcome of the next roll in draw, if set
+    income_estimator *estimator_ = nullptr;
+    // every signal passed to btn is appended here, if set
+    list<ui::signal> *recorded_ = nullptr;
+    int rolls = 0;
+    // exact rolls many dice one by one in the rng order of roll_d6, fast samples
+    // their face counts at once: the same distribution, but other numbers
+    enum dice_mode { dice_exact, dice_fast };
+    dice_mode dice_mode_ = dice_exact;
+
+    dice_hash roll_d6();
+    // adds the faces of count d6 rolls to rolled
+    void roll_d6s(int count, int (&rolled)[dice_pool::faces]);
+    bool inc_dice(dice_hash, int added = 1);
+    void inc_dice(const int (&added)[dice_pool::faces]) { dice_.inc(added); }
+    bool inc_gold(int added);
+    dice_hash has_dice(dice::filter, int count = 1, dice::comparer = nullptr) const;
+    template<typename filter_t, typename comparer_t = std::nullptr_t>
+    dice_hash has_dice(filter_t f, int count = 1, comparer_t c = nullptr) const;
+    template<typename query_t>
+    dice_hash find_dice(query_t q) const { return q(dice_); }
+    void insert_room(int r, shared<room>);
+    // a room in the arena of this state
+    template<typename room_t, typename... args_t>
+    shared<room> make_room(args_t &&...args) const
+    {
+        return std::allocate_shared<room_t>(room_allocator<room_t>(arena_), std::forward<args_t>(args)...);
+    }
+    room_allocator<room> allocator() const { return room_allocator<room>(arena_); }
+
+    void next_roll();
+    void reset();
+    // a branch of the game with no ui attached, in O(1): it shares the rooms and their
+    // layout with this state until either side changes them, which then gets its own copy
+    state fork() const;
+    // lets the first room able to do it activate, in bulk unless the steps are recorded
+    bool activate_next();
+    // rolls without recording any frames, so the rooms take their bulk paths,
+    // until one of the conditions or the end of the game
+    skip_summary skip(const skip_until &);
+    // rolls for elapsed seconds of wall time in skips of a batch at most, shown like a skip
+    catch_up_summary catch_up(double elapsed, const catch_up_options &);
+    void seed(unsigned s, unsigned stream = 0);
+
+    enum game { gaming, lost_by_debt, won_by_panacea };
+    game game_state() const { return state_; }
+
+    int gold() const { return gold_; }
+    const dice_pool &pool() const { return dice_; }
+    int room_count() const { return int(layout_->rooms.size()); }
+    const room &room_at(int r) const { return *layout_->rooms.at(r); }
+    int shop_count() const { return int(layout_->shop.size()); }
+    const room &shop_at(int s) const { return *layout_->shop.at(s); }
+    const debt_registry &debts() const { return debts_; }
+    // positions of the rooms of a type, in order
+    const vector<int> &rooms_of(room_type t) const { return layout_->by_type[t]; }
+    int count_of(room_type t) const { return int(layout_->by_type[t].size()); }
+    void draw(ui &) const;
+    // draws the state as it was at the step, activates are per room
+    void draw(ui &, const frame_step &, const vector<int> &activates) const;
+    bool btn(ui::signal);
+    // the whole game except ui, to be resumed later by load
+    bool save(snapshot &) const;
+    bool load(const snapshot &);
+    bool move_room(int r, int mod);
+    bool sell_room(int r);
+    bool buy_room(int u);
+
+private:
+    // a new game with its rooms in the arena
+    explicit state(shared<room_arena>);
+    shared<room_arena> arena_;
+    dice_pool dice_;
+    struct layout
+    {
+        list<shared<room>> rooms;
+        list<shared<room>> shop;
+        // positions of the rooms by type
+        vector<int> by_type[rt_count];
+    };
+    // shared with forks until either side changes it
+    shared<layout> layout_;
+    // activations of every room in the roll going on, empty between rolls
+    vector<int> activates_;
+    int gold_ = 0;
+    random_engine rng_;
+    game state_ = gaming;
+    debt_registry debts_;
+    // the last skip, shown until the next button
+    skip_summary skipped_;
+    // gives the state its own copy of the layout shared with a fork before it is changed
+    layout &mut_layout_();
+    // rebuilds by_type after the rooms changed their order
+    void index_rooms_();
+    // gives the state its own copy of a room shared with a fork before it is changed
+    room &mut_room_(int r);
+    // a room about to activate, copied first if activating changes it
+    const shared<room> &activating_(int r);
+    // adds (sign 1) or removes (sign -1) the debt of a room, if it is an outstanding collector
+    void track_debt_(const room &, int sign);
+    void draw_(ui &, const frame_step *, const vector<int> *activates) const;
+    friend struct debt_collector;
+    friend struct panacea;
+};
+
+template<typename filter_t, typename comparer_t>
+dice_hash state::has_dice(filter_t f, int count, comparer_t c) const
+{
+    assert(count >= 1);
+    dice_hash best = dh_invalid;
+    for (int i = 0; i < dice_pool::faces; ++i) {
+        if (!(dice_.mask() & (1u << i)))
+            continue;
+        const dice_hash dh = dice_pool::hash(i);
+        if (dice_.count(dh) < count || !f(dh))
+            continue;
+        if constexpr (std::is_same_v<comparer_t, std::nullptr_t>)
+            return dh;
+        else if (best == dh_invalid || c(dh, best))
+            best = dh;
+    }
+    return best;
+}
+
+// how an upgrade value or price changes with every level
+struct growing_number
+{
+    enum kind { linear, multiply };
+    kind k = linear;
+    double by = 0;
+    constexpr double next(double v) const { return k == linear ? v + by : v * by; }
+};
+constexpr growing_number linear_growing_number(double inc) { return { growing_number::linear, inc }; }
+constexpr growing_number multiply_growing_number(double mult) { return { growing_number::multiply, mult }; }
+
+// value and price of an upgrade at every level, expanded once per room type at compile time;
+// a level_max above max_levels does not compile
+struct upgrade_curve
+{
+    enum { max_levels = 10 };
+    constexpr upgrade_curve(double v, growing_number vadd,
+                            double p, growing_number padd,
+                            int lvl_max, const char *description) :
+        level_max(lvl_max), description(description)
+    {
+        value[0] = v;
+        price[0] = p;
+        for (int l = 1; l <= lvl_max; ++l) {
+            value[l] = vadd.next(value[l - 1]);
+            price[l] = padd.next(price[l - 1]);
+        }
+    }
+    double value[max_levels + 1] = {};
+    // price of the level after the one at the same index
+    double price[max_levels + 1] = {};
+    int level_max = 0;
+    const char *description = "";
+};
+
+struct upgrade
+{
+    upgrade() = default;
+    explicit upgrade(const upgrade_curve &c) : curve_(&c) {}
+    bool level_up(state &s);
+    // levels up for free, e.g. when a saved room is restored
+    bool set_level(int lvl);
+    int value_ceil() const { return ceil(value()); }
+    int value_floor() const { return floor(value()); }
+    double value() const { return curve_->value[level_]; }
+    void draw(ui &, ui::signal) const;
+    int level() const { return level_; }
+    int level_max() const { return curve_->level_max; }
+private:
+    int price() const { return ceil(curve_->price[level_]); }
+    const upgrade_curve *curve_ = nullptr;
+    int level_ = 0;
+};
+
+struct room
+{
+    virtual ~room() = default;
+    // done is the activations of the room in this roll so far, kept by the state,
+    // so a room shared between forks stays the same while they roll
+    bool activate(state &, int &done);
+    // activates up to budget times in a row (-1 for no limit) as if activate() was called
+    // again and again with no other room in between, returns the number of activations
+    int activate_bulk(state &, int &done, int budget);
+    // activates the count rooms of this type standing in a row at run, each one in bulk
+    // until it is exhausted as if the next one was asked only after that, and stops at
+    // the first one left awake; returns the number of rooms left exhausted before it
+    int activate_run(state &, const shared<room> *run, int *done, int count, bool &activated);
+    bool exhausted(int done) const { return activates_max_() != -1 && done >= activates_max_(); }
+    // whether activating changes the room itself, not only the state
+    virtual bool changes_on_activate() const { return false; }
+    // filled only while a profile is attached to the state
+    room_stats stats_;
+    enum { max_upgrades = 4 };
+    int upgrade_count() const { return upgrade_count_; }
+    bool level_up_upgrade(int u, state &s);
+    void draw(ui &o, int r) const { draw(o, r, 0); }
+    void draw(ui &, int r, int activates) const;
+    int level() const;
+    virtual void draw_info(ui &, int) const {}
+    virtual const char *name() const { return "Room"; }
+    virtual int price() const { return 100; }
+    virtual shared<room> duplicate(const room_allocator<room> &) const = 0;
+    // a copy with the same upgrades and debt
+    virtual shared<room> clone(const room_allocator<room> &) const = 0;
+    room_type type() const { return type_; }
+    // a new room of the type, nullptr for an unknown type
+    static shared<room> create(room_type, const room_allocator<room> &);
+    // rooms are saved and modelled as they are between rolls, with no activations done
+    void save(snapshot_room &) const;
+    bool load(const snapshot_room &);
+    void model(room_model &) const;
+protected:
+    explicit room(room_type t) : type_(t) {}
+    virtual void save_(snapshot_room &) const {}
+    virtual bool load_(const snapshot_room &) { return true; }
+    virtual void model_(room_model &) const {}
+    virtual bool activate_(state &, int) { return false; }
+    // does at most left (-1 for no limit) activations, one by default
+    virtual int activate_bulk_(state &s, int done, int) { return activate_(s, done) ? 1 : 0; }
+    // one room after another by default, a type may do the whole run in one loop
+    virtual int activate_run_(state &, const shared<room> *run, int *done, int count, bool &activated);
+    virtual int activates_max_() const { return 1; }
+    // upgrades are added in the order of their ids, from 0
+    void add_upgrade(int, const upgrade_curve &);
+    int upgrade_value_ceil(int u) const { return upgrade_at_(u).value_ceil(); }
+    int upgrade_value_floor(int u) const { return upgrade_at_(u).value_floor(); }
+    int upgrade_value_multiplier(int u, int x = 1) const { return floor(upgrade_at_(u).value() * x); }
+    double upgrade_value(int u) const { return upgrade_at_(u).value(); }
+private:
+    room_type type_;
+    upgrade upgrades_[max_upgrades];
+    int upgrade_count_ = 0;
+    const upgrade &upgrade_at_(int u) const
+    {
+        assert(0 <= u && u < upgrade_count_);
+        return upgrades_[u];
+    }
+    bool activate_one_(state &, int &done);
+    int activate_bulk_budget_(state &, int &done, int budget);
+    template<typename activate_t>
+    int profiled_(state &, int done, activate_t);
+};
+
+// content impl
+
+template <typename room_impl>
+struct room_duplicate : room
+{
+    room_duplicate() : room(room_impl::type_id) {}
+    shared<room> duplicate(const room_allocator<room> &a) const override
+    {
+        return std::allocate_shared<room_impl>(room_allocator<room_impl>(a));
+    }
+    shared<room> clone(const room_allocator<room> &a) const override
+    {
+        return std::allocate_shared<room_impl>(room_allocator<room_impl>(a), static_cast<const room_impl &>(*this));
+    }
+};
+
+struct herbalist : room_duplicate<herbalist>
+{
+    static constexpr room_type type_id = rt_herbalist;
+    const char *name() const override { return "Herbalist"; }
+    enum { activates };
+    herbalist();
+    bool activate_(state &s, int done) override;
+    int activate_bulk_(state &s, int done, int left) override;
+    int activate_run_(state &s, const shared<room> *run, int *done, int count, bool &activated) override;
+    int activates_max_() const override;
+    void draw_info(ui &o, int activates) const override;
+};
+
+struct seller : room_duplicate<seller>
+{
+    static constexpr room_type type_id = rt_seller;
+    const char *name() const override { return "Leftovers Salesman"; }
+    enum { money_mult };
+    seller();
+    bool activate_(state &s, int done) override;
+    int activate_bulk_(state &s, int done, int left) override;
+    int activates_max_() const override;
+    void draw_info(ui &o, int activates) const override;
+protected:
+    void model_(room_model &) const override;
+};
+
+struct mass_seller : room_duplicate<mass_seller>
+{
+    static constexpr room_type type_id = rt_mass_seller;
+    const char *name() const override { return "Mass Salesman"; }
+    enum { activates, base_price };
+    mass_seller();
+    bool activate_(state &s, int done) override;
+    int activate_bulk_(state &s, int done, int left) override;
+    int activates_max_() const override;
+    void draw_info(ui &o, int activates) const override;
+protected:
+    void model_(room_model &) const override;
+};
+
+struct splitter : room_duplicate<splitter>
+{
+    static constexpr room_type type_id = rt_splitter;
+    enum { max_split_count };
+    const char *name() const override { return "Blender"; }
+    splitter();
+    bool activate_(state &s, int done) override;
+    void draw_info(ui &o, int activates) const override;
+protected:
+    void model_(room_model &) const override;
+};
+
+struct debt_collector : room_duplicate<debt_collector>
+{
+    static constexpr room_type type_id = rt_debt_collector;
+    enum { total_take_percent, bribed };
+    debt_collector(int waits_gold = 0);
+    const char *name() const override { return "Debt Collector"; }
+    bool activate_(state &s, int done) override;
+    void draw_info(ui &o, int activates) const override;
+    int price() const override;
+    int waits_gold() const { return waits_gold_; }
+    bool changes_on_activate() const override { return waits_gold_ > 0; }
+protected:
+    void save_(snapshot_room &) const override;
+    bool load_(const snapshot_room &) override;
+    void model_(room_model &) const override;
+private:
+    int waits_gold_ = 0;
+    int waits_gold_total_ = 0;
+};
+
+struct panacea : room_duplicate<panacea>
+{
+    static constexpr room_type type_id = rt_panacea;
+    const char *name() const override { return "Panacea"; }
+    bool activate_(state &s, int done) override;
+    void draw_info(ui &o, int activates) const override;
+    int price() const override { return 20000; }
+};
+
+struct ui_cmd : ui
+{
+    ui_cmd(out &o) : o(o) {}
+    ui &operator<<(int) override;
+    ui &operator<<(double) override;
+    ui &operator<<(const str &) override;
+    ui &operator<<(const char *) override;
+    ui &operator<<(symbol) override;
+    void nl() override { o << "<br>"; }
+    void flush() override { o.flush(); }
+    void begin_room() override;
+    void end_room() override;
+    void begin_upgrade() override;
+    void end_upgrade() override;
+    void begin_button(signal) override;
+    void end_button() override;
+    void begin_paragraph() override;
+    void end_paragraph() override;
+    void begin_list() override;
+    void end_list() override;
+private:
+    out &o;
+    enum scope { scope_room, scope_upgrade, scope_btn, scope_p, scope_ul };
+    static const char *scope_str(scope s);
+    list<scope> scopes_stack_;
+    void push_scope(scope);
+    void pop_scope(scope);
+};
+
+// writes html into a buffer that keeps its capacity between frames,
+// so once it has grown rendering a frame does not allocate
+struct ui_html : ui
+{
+    ui_html(bool indent = false) : indent_(indent) {}
+    ui &operator<<(int) override;
+    ui &operator<<(double) override;
+    ui &operator<<(const str &s) override { append(s.data(), s.size()); return *this; }
+    ui &operator<<(const char *) override;
+    ui &operator<<(symbol) override;
+    void nl() override { append("<br>"); }
+    void begin_room() override { open(scope_li, "<li>"); }
+    void end_room() override { close(scope_li, "</li>"); }
+    void begin_upgrade() override { open(scope_li, "<li>"); }
+    void end_upgrade() override { close(scope_li, "</li>"); }
+    void begin_button(signal) override;
+    void end_button() override { close(scope_a, "]</a>"); }
+    void begin_paragraph() override { open(scope_p, "<p>"); }
+    void end_paragraph() override { close(scope_p, "</p>"); }
+    void begin_list() override { open(scope_ul, "<ul>"); }
+    void end_list() override { close(scope_ul, "</ul>"); }
+
+    const char *data() const { return buf_.data(); }
+    int size() const { return int(buf_.size()); }
+    void clear() { buf_.clear(); }
+private:
+    enum scope { scope_li, scope_a, scope_p, scope_ul };
+    enum { max_depth = 32 };
+    void append(const char *s, size_t n) { buf_.append(s, n); }
+    void append(const char *s);
+    void open(scope, const char *tag);
+    void close(scope, const char *tag);
+    void indent();
+    str buf_;
+    scope scopes_[max_depth] = {};
+    int depth_ = 0;
+    bool indent_ = false;
+};
+
+}
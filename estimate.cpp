@@ -0,0 +1,311 @@
+#include <estimate.h>
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+namespace ca {
+
+bool room_model::operator==(const room_model &o) const
+{
+    return type == o.type && left == o.left && !memcmp(gain, o.gain, sizeof(gain))
+            && price == o.price && split == o.split
+            && waits == o.waits && take == o.take && bribe == o.bribe;
+}
+
+namespace {
+
+// a state of the roll, as the numbers that may change during it:
+// the game, the gold (only when a debt depends on it), the pool, then the activations left
+// and the awaited gold of every room; dice just rolled stay pending, uniform over the faces
+// not looked at yet, until a room needs to know whether there are some of a face
+using key = u32string;
+enum { key_game, key_gold, key_pool, key_pending = key_pool + dice_pool::faces, key_unseen, key_rooms };
+const int all_faces = (1 << dice_pool::faces) - 1;
+
+int get(const key &k, int i) { return int(k[i]); }
+void set(key &k, int i, int v) { k[i] = char32_t(v); }
+void add(key &k, int i, int v) { k[i] = char32_t(int(k[i]) + v); }
+
+int bits(int m)
+{
+    int n = 0;
+    for (; m; m &= m - 1)
+        ++n;
+    return n;
+}
+
+// probability of a state and the sums of its gold delta and squared delta over it
+struct moments
+{
+    double p = 0;
+    double g = 0;
+    double g2 = 0;
+};
+
+struct roll_model
+{
+    vector<room_model> rooms;
+    vector<int> left0;
+    int gold = 0;
+    bool gold_in_key = false;
+    unordered_map<key, moments> *next = nullptr;
+
+    int left(const key &k, int r) const { return get(k, key_rooms + 2 * r); }
+    int waits(const key &k, int r) const { return get(k, key_rooms + 2 * r + 1); }
+
+    void emit(const key &k, const moments &m, double q, int gold_added)
+    {
+        moments &to = (*next)[k];
+        const double a = gold_added;
+        to.p += q * m.p;
+        to.g += q * (m.g + a * m.p);
+        to.g2 += q * (m.g2 + 2 * a * m.g + a * a * m.p);
+    }
+
+    // splits the state by how many of the pending dice show the face
+    void reveal(const key &k, const moments &m, int f)
+    {
+        const int pending = get(k, key_pending);
+        const int unseen = get(k, key_unseen);
+        const double p = 1.0 / bits(unseen);
+        key to = k;
+        set(to, key_unseen, unseen & ~(1 << f));
+        // binomial(pending, p), term by term
+        double q = pow(1 - p, pending);
+        for (int c = 0; c <= pending; ++c) {
+            set(to, key_pool + f, get(k, key_pool + f) + c);
+            set(to, key_pending, pending - c);
+            if (q > 0)
+                emit(to, m, q, 0);
+            q = p < 1 ? q * (pending - c) / (c + 1) * p / (1 - p) : double(c + 1 == pending);
+        }
+    }
+
+    // whether there are dice of face f: 1 yes, 0 no, -1 unknown until revealed
+    int has(const key &k, int f) const
+    {
+        if (get(k, key_pool + f))
+            return 1;
+        if (!get(k, key_pending) || !(get(k, key_unseen) & (1 << f)))
+            return 0;
+        return -1;
+    }
+
+    // the first face from..to (step 1 or -1) with dice, -1 for none,
+    // or the face to reveal first as -2 - face
+    int find(const key &k, int from, int to, int step) const
+    {
+        for (int f = from; f != to + step; f += step) {
+            const int h = has(k, f);
+            if (h > 0)
+                return f;
+            if (h < 0)
+                return -2 - f;
+        }
+        return -1;
+    }
+
+    // does one activation of the first room able to do it, or reveals what it needs to know;
+    // false if no room is able to activate
+    bool step(const key &k, const moments &m)
+    {
+        const int faces = dice_pool::faces;
+        for (int r = 0; r < int(rooms.size()); ++r) {
+            const room_model &room = rooms[r];
+            const int left = this->left(k, r);
+            if (!left)
+                continue;
+            key to = k;
+            if (left > 0)
+                set(to, key_rooms + 2 * r, left - 1);
+            switch (room.type) {
+            case rt_herbalist: {
+                // a new die is one of the unseen faces with their share, or shows a seen face
+                const int unseen = get(k, key_unseen);
+                key die = to;
+                add(die, key_pending, 1);
+                emit(die, m, double(bits(unseen)) / faces, 0);
+                for (int f = 0; f < faces; ++f) {
+                    if (unseen & (1 << f))
+                        continue;
+                    die = to;
+                    add(die, key_pool + f, 1);
+                    emit(die, m, 1.0 / faces, 0);
+                }
+                return true;
+            }
+            case rt_seller:
+            case rt_mass_seller: {
+                const int f = find(k, 0, faces - 1, 1);
+                if (f == -1)
+                    continue;
+                if (f < -1) {
+                    reveal(k, m, -2 - f);
+                    return true;
+                }
+                add(to, key_pool + f, -1);
+                const int gold = room.type == rt_seller ? room.gain[f] : room.price + left0[r] - left;
+                if (gold_in_key)
+                    add(to, key_gold, gold);
+                emit(to, m, 1, gold);
+                return true;
+            }
+            case rt_splitter: {
+                // the biggest die up to the split count, if it is 3+, or the smallest 3+ one
+                int f = find(k, min(room.split, faces) - 1, 0, -1);
+                if (f >= 0 && f < 2)
+                    f = -1;
+                if (f == -1)
+                    f = find(k, 2, faces - 1, 1);
+                if (f == -1)
+                    continue;
+                if (f < -1) {
+                    reveal(k, m, -2 - f);
+                    return true;
+                }
+                add(to, key_pool + f, -1);
+                add(to, key_pool, min(room.split, f + 1));
+                emit(to, m, 1, 0);
+                return true;
+            }
+            case rt_debt_collector: {
+                const int waits = this->waits(k, r);
+                if (!waits)
+                    continue;
+                int debts = 0;
+                for (int o = 0; o < int(rooms.size()); ++o)
+                    debts += this->waits(k, o) > 0;
+                if (debts > 1) {
+                    set(to, key_game, state::lost_by_debt);
+                    emit(to, m, 1, 0);
+                    return true;
+                }
+                // only reached with the gold in the key
+                const int gold = this->gold + get(k, key_gold);
+                const int taken = min(gold, min(waits, room.take));
+                const int paid = int(floor(room.bribe * taken));
+                if (paid > gold)
+                    continue;
+                add(to, key_gold, -paid);
+                set(to, key_rooms + 2 * r + 1, waits - taken);
+                emit(to, m, 1, -paid);
+                return true;
+            }
+            case rt_panacea:
+                set(to, key_game, state::won_by_panacea);
+                emit(to, m, 1, 0);
+                return true;
+            default:
+                continue;
+            }
+        }
+        return false;
+    }
+};
+
+}
+
+income_estimate estimate_income(const state &s, int max_states)
+{
+    assert(max_states > 0);
+    income_estimate e;
+    if (s.game_state() != state::gaming)
+        return e;
+
+    roll_model model;
+    model.gold = s.gold();
+    key start(key_rooms + 2 * s.room_count(), 0);
+    set(start, key_game, state::gaming);
+    set(start, key_unseen, all_faces);
+    for (int f = 0; f < dice_pool::faces; ++f)
+        set(start, key_pool + f, s.pool().count(dice_pool::hash(f)));
+    for (int r = 0; r < s.room_count(); ++r) {
+        room_model m;
+        s.room_at(r).model(m);
+        model.gold_in_key = model.gold_in_key || (m.type == rt_debt_collector && m.waits && m.left);
+        set(start, key_rooms + 2 * r, m.left);
+        set(start, key_rooms + 2 * r + 1, m.waits);
+        model.rooms.push_back(m);
+        model.left0.push_back(m.left);
+    }
+
+    unordered_map<key, moments> live, next;
+    live[start] = moments{1, 0, 0};
+    double kept = 1, g = 0, g2 = 0, d = 0, d2 = 0;
+    model.next = &next;
+    while (!live.empty()) {
+        e.states = max(e.states, int(live.size()));
+        next.clear();
+        for (const auto &it : live) {
+            if (model.step(it.first, it.second))
+                continue;
+            // no room is able to activate, the roll ends here
+            const moments &m = it.second;
+            int dice = get(it.first, key_pending) - s.pool().total();
+            for (int f = 0; f < dice_pool::faces; ++f)
+                dice += get(it.first, key_pool + f);
+            g += m.g;
+            g2 += m.g2;
+            d += m.p * dice;
+            d2 += m.p * dice * dice;
+            if (get(it.first, key_game) == state::lost_by_debt)
+                e.lost += m.p;
+            if (get(it.first, key_game) == state::won_by_panacea)
+                e.won += m.p;
+        }
+        if (int(next.size()) > max_states) {
+            vector<pair<double, const key *>> order;
+            order.reserve(next.size());
+            for (const auto &it : next)
+                order.push_back({ it.second.p, &it.first });
+            nth_element(order.begin(), order.begin() + max_states, order.end(),
+                        [](const auto &a, const auto &b) { return a.first > b.first; });
+            for (auto it = order.begin() + max_states; it != order.end(); ++it)
+                e.dropped += it->first;
+            live.clear();
+            for (auto it = order.begin(); it != order.begin() + max_states; ++it)
+                live.emplace(*it->second, next[*it->second]);
+        } else {
+            swap(live, next);
+        }
+    }
+    kept -= e.dropped;
+    if (kept <= 0)
+        return e;
+    e.gold = g / kept;
+    e.gold_var = max(0.0, g2 / kept - e.gold * e.gold);
+    e.dice = d / kept;
+    e.dice_var = max(0.0, d2 / kept - e.dice * e.dice);
+    e.lost /= kept;
+    e.won /= kept;
+    return e;
+}
+
+const income_estimate &income_estimator::get(const state &s)
+{
+    bool same = valid_ && gold_ == s.gold() && int(rooms_.size()) == s.room_count();
+    for (int f = 0; same && f < dice_pool::faces; ++f)
+        same = pool_.count(dice_pool::hash(f)) == s.pool().count(dice_pool::hash(f));
+    for (int r = 0; same && r < s.room_count(); ++r) {
+        room_model m;
+        s.room_at(r).model(m);
+        same = m == rooms_[r];
+    }
+    if (same && s.game_state() == state::gaming)
+        return last_;
+
+    last_ = estimate_income(s, max_states);
+    valid_ = true;
+    gold_ = s.gold();
+    pool_ = s.pool();
+    rooms_.resize(s.room_count());
+    for (int r = 0; r < s.room_count(); ++r)
+        s.room_at(r).model(rooms_[r]);
+    return last_;
+}
+
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <core.h>
+
+namespace ca {
+
+// what a room does during a roll, as plain numbers the estimator can branch on
+struct room_model
+{
+    room_type type = rt_invalid;
+    // activations left in this roll, -1 for no limit
+    int left = 0;
+    // seller: gold for a sold die by its value
+    int gain[dice_pool::faces] = {};
+    // mass_seller: gold for the next sold die, one more for every sale after it
+    int price = 0;
+    // splitter: dice a die splits into at most
+    int split = 0;
+    // debt_collector: gold still awaited, taken at most per activation, and the part of it paid
+    int waits = 0;
+    int take = 0;
+    double bribe = 0;
+    bool operator==(const room_model &) const;
+};
+
+// the outcome of the next roll: exact means and variances over every way the dice may fall
+struct income_estimate
+{
+    double gold = 0;
+    double gold_var = 0;
+    double dice = 0;
+    double dice_var = 0;
+    // chances the roll ends the game
+    double lost = 0;
+    double won = 0;
+    // chance left out by the cap on states, the rest is renormalized
+    double dropped = 0;
+    // the most distinct states alive at once
+    int states = 0;
+};
+
+// runs a roll over distributions of the pool instead of rolling, following the rooms in order
+// with the same rules as state::activate_next, and merges equal states on the way;
+// above max_states only the likeliest states are followed
+income_estimate estimate_income(const state &, int max_states = 4096);
+
+// keeps the last estimate until the rooms, their upgrades, the pool or the gold change
+struct income_estimator
+{
+    int max_states = 4096;
+    const income_estimate &get(const state &);
+private:
+    bool valid_ = false;
+    vector<room_model> rooms_;
+    dice_pool pool_;
+    int gold_ = 0;
+    income_estimate last_;
+};
+
+}
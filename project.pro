@@ -5,5 +5,5 @@ CONFIG -= app_bundle
 
 QMAKE_CXXFLAGS += -Werror=enum-compare -Werror=return-type
 
-HEADERS += main.h
-SOURCES += main.cpp
+HEADERS += core.h estimate.h main.h rng.h snapshot.h replay.h varint.h
+SOURCES += core.cpp estimate.cpp main.cpp snapshot.cpp replay.cpp
@@ -0,0 +1,141 @@
+#include <replay.h>
+#include <varint.h>
+
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+namespace ca {
+
+namespace {
+
+const char magic[4] = { 'C', 'A', 'I', 'L' };
+enum { version = 2 };
+
+list<int> layout_of(const state &s)
+{
+    list<int> layout;
+    layout.reserve(s.room_count() * 2);
+    for (int i = 0; i < s.room_count(); ++i) {
+        layout.push_back(s.room_at(i).type());
+        layout.push_back(s.room_at(i).level());
+    }
+    return layout;
+}
+
+}
+
+void input_log::record(state &s, unsigned seed_)
+{
+    *this = input_log{};
+    seed = seed_;
+    s.seed(seed);
+    s.reset();
+    s.recorded_ = &signals;
+}
+
+void input_log::finish(state &s)
+{
+    if (s.recorded_ == &signals)
+        s.recorded_ = nullptr;
+    gold = s.gold();
+    rolls = s.rolls;
+    game = s.game_state();
+    layout = layout_of(s);
+}
+
+bool input_log::matches(const state &s) const
+{
+    return s.gold() == gold && s.rolls == rolls && s.game_state() == game && layout_of(s) == layout;
+}
+
+bool input_log::save(const char *path) const
+{
+    // signals mostly repeat, so they are stored as varint deltas
+    str o(magic, sizeof(magic));
+    put_varint(o, version);
+    put_varint(o, seed);
+    put_varint(o, gold);
+    put_varint(o, rolls);
+    put_varint(o, game);
+    put_varint(o, (long long)layout.size());
+    for (int v : layout)
+        put_varint(o, v);
+    put_varint(o, (long long)signals.size());
+    long long last = 0;
+    for (ui::signal v : signals) {
+        put_varint(o, v - last);
+        last = v;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    const bool ok = fwrite(o.data(), 1, o.size(), f) == o.size();
+    return fclose(f) == 0 && ok;
+}
+
+bool input_log::load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    str in;
+    char b[4096];
+    for (size_t n; (n = fread(b, 1, sizeof(b), f)) > 0;)
+        in.append(b, n);
+    fclose(f);
+
+    if (in.size() < sizeof(magic) || memcmp(in.data(), magic, sizeof(magic)))
+        return false;
+    size_t pos = sizeof(magic);
+    long long v = 0, count = 0;
+    input_log log;
+    if (!get_varint(in, pos, v) || v != version)
+        return false;
+    if (!get_varint(in, pos, v))
+        return false;
+    log.seed = unsigned(v);
+    if (!get_varint(in, pos, v))
+        return false;
+    log.gold = int(v);
+    if (!get_varint(in, pos, v))
+        return false;
+    log.rolls = int(v);
+    if (!get_varint(in, pos, v))
+        return false;
+    log.game = int(v);
+    if (!get_varint(in, pos, count) || count < 0)
+        return false;
+    for (long long i = 0; i < count; ++i) {
+        if (!get_varint(in, pos, v))
+            return false;
+        log.layout.push_back(int(v));
+    }
+    if (!get_varint(in, pos, count) || count < 0)
+        return false;
+    long long last = 0;
+    for (long long i = 0; i < count; ++i) {
+        if (!get_varint(in, pos, v))
+            return false;
+        last += v;
+        log.signals.push_back(ui::signal(last));
+    }
+    if (pos != in.size())
+        return false;
+    *this = std::move(log);
+    return true;
+}
+
+bool replay(const input_log &log, state &s)
+{
+    assert(!s.ui_);
+    s.seed(log.seed);
+    s.reset();
+    for (ui::signal v : log.signals)
+        s.btn(v);
+    return log.matches(s);
+}
+
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <core.h>
+
+namespace ca {
+
+// a game as the player pressed it: the seed and every signal passed to state::btn,
+// plus how the game ended, to check a replay against
+struct input_log
+{
+    unsigned seed = 0;
+    list<ui::signal> signals;
+
+    int gold = 0;
+    int rolls = 0;
+    int game = state::gaming;
+    // type and level of every room in order
+    list<int> layout;
+
+    // starts recording a game into the log
+    void record(state &, unsigned seed);
+    // stops recording and stores how the game ended
+    void finish(state &);
+    bool matches(const state &) const;
+
+    bool save(const char *path) const;
+    bool load(const char *path);
+};
+
+// drives the state through the log with no ui, true if the result matches the recording
+bool replay(const input_log &, state &);
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+namespace ca {
+
+// Philox4x32-10 counter based generator: the n-th number is a function of (key, stream, n),
+// so the whole state is a few words, jumping ahead is O(1) and streams never overlap
+struct philox
+{
+    using result_type = uint32_t;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    explicit philox(uint64_t key = 0, uint64_t stream = 0) { seed(key, stream); }
+    void seed(uint64_t key, uint64_t stream = 0)
+    {
+        key_[0] = uint32_t(key);
+        key_[1] = uint32_t(key >> 32);
+        stream_ = stream;
+        pos_ = 0;
+    }
+    result_type operator()()
+    {
+        const unsigned i = unsigned(pos_ & 3);
+        if (!i)
+            block(pos_ >> 2, buf_);
+        ++pos_;
+        return buf_[i];
+    }
+    void discard(uint64_t n)
+    {
+        pos_ += n;
+        if (pos_ & 3)
+            block(pos_ >> 2, buf_);
+    }
+    uint64_t position() const { return pos_; }
+    // an independent generator for e.g. a room or a thread, keyed by this one and id
+    philox derive(uint64_t id) const
+    {
+        uint32_t k[4];
+        const uint32_t c[4] = { uint32_t(id), uint32_t(id >> 32), ~uint32_t(stream_), ~uint32_t(stream_ >> 32) };
+        round10(c, key_, k);
+        return philox(uint64_t(k[0]) | uint64_t(k[1]) << 32, uint64_t(k[2]) | uint64_t(k[3]) << 32);
+    }
+    bool operator==(const philox &o) const
+    {
+        return key_[0] == o.key_[0] && key_[1] == o.key_[1] && stream_ == o.stream_ && pos_ == o.pos_;
+    }
+    bool operator!=(const philox &o) const { return !(*this == o); }
+
+private:
+    uint32_t key_[2] = {};
+    uint64_t stream_ = 0;
+    // numbers handed out so far, the block of 4 in buf_ is the one pos_ points into
+    uint64_t pos_ = 0;
+    uint32_t buf_[4] = {};
+
+    void block(uint64_t n, uint32_t (&out)[4]) const
+    {
+        const uint32_t c[4] = { uint32_t(n), uint32_t(n >> 32), uint32_t(stream_), uint32_t(stream_ >> 32) };
+        round10(c, key_, out);
+    }
+    static void round10(const uint32_t (&in)[4], const uint32_t (&key)[2], uint32_t (&out)[4])
+    {
+        uint32_t c0 = in[0], c1 = in[1], c2 = in[2], c3 = in[3];
+        uint32_t k0 = key[0], k1 = key[1];
+        for (int r = 0; r < 10; ++r) {
+            const uint64_t p0 = uint64_t(0xD2511F53u) * c0;
+            const uint64_t p1 = uint64_t(0xCD9E8D57u) * c2;
+            const uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+            const uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+            c1 = uint32_t(p1);
+            c3 = uint32_t(p0);
+            c0 = n0;
+            c2 = n2;
+            k0 += 0x9E3779B9u;
+            k1 += 0xBB67AE85u;
+        }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+    }
+};
+
+}
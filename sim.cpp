@@ -0,0 +1,345 @@
+#include <sim.h>
+
+#include <estimate.h>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+using namespace std;
+
+namespace ca {
+
+namespace {
+
+struct work_queue
+{
+    bool pop_front(int &job)
+    {
+        lock_guard<mutex> lock(m_);
+        if (jobs_.empty())
+            return false;
+        job = jobs_.front();
+        jobs_.pop_front();
+        return true;
+    }
+    bool pop_back(int &job)
+    {
+        lock_guard<mutex> lock(m_);
+        if (jobs_.empty())
+            return false;
+        job = jobs_.back();
+        jobs_.pop_back();
+        return true;
+    }
+    void push_back(int job) { jobs_.push_back(job); }
+private:
+    mutex m_;
+    deque<int> jobs_;
+};
+
+// set while a thread runs jobs of run_parallel
+thread_local bool in_pool = false;
+
+}
+
+void policy_greedy(state &s)
+{
+    int best = -1;
+    for (int i = 0; i < s.shop_count(); ++i)
+        if (best == -1 || s.shop_at(i).price() > s.shop_at(best).price())
+            best = i;
+    if (best != -1 && s.btn(ui::mk_room_buy(best)))
+        return;
+
+    for (int r = 0; r < s.room_count(); ++r)
+        for (int u = 0; u < s.room_at(r).upgrade_count(); ++u)
+            if (s.btn(ui::mk_room_upgrade(r, u)))
+                return;
+}
+
+namespace {
+
+// a sequence of presses on a fork of the game, with the fork after them
+struct press_line
+{
+    list<ui::signal> presses;
+    state after;
+    double score = 0;
+};
+
+// appends the lines one press longer than l: every affordable buy, upgrade, move and sell
+void expand(const press_line &l, list<press_line> &out)
+{
+    const state &s = l.after;
+    auto add = [&](ui::signal c) {
+        state t = s.fork();
+        if (t.btn(c)) {
+            out.push_back(press_line{ l.presses, move(t) });
+            out.back().presses.push_back(c);
+        }
+    };
+    // rooms are kept addressable by signals, with places left for the debt collectors
+    // and the Panacea
+    for (int i = 0; i < s.shop_count(); ++i)
+        if (s.room_count() < ui::max_rooms - 4
+                || (s.shop_at(i).type() == rt_panacea && s.room_count() < ui::max_rooms))
+            add(ui::mk_room_buy(i));
+    // rooms of the same type, upgrades and level do the same: only the first of them is
+    // upgraded, only the last is sold, and none is moved past another
+    vector<room_model> models(s.room_count());
+    for (int r = 0; r < s.room_count(); ++r)
+        s.room_at(r).model(models[r]);
+    auto same = [&](int a, int b) {
+        return models[a] == models[b] && s.room_at(a).level() == s.room_at(b).level();
+    };
+    for (int r = 0; r < min(s.room_count(), int(ui::max_rooms)); ++r) {
+        bool first = true, last = true;
+        for (int o = 0; o < s.room_count() && (first || last); ++o) {
+            first = first && (o >= r || !same(o, r));
+            last = last && (o <= r || !same(o, r));
+        }
+        for (int u = 0; first && u < s.room_at(r).upgrade_count(); ++u)
+            add(ui::mk_room_upgrade(r, u));
+        if (r > 0 && !same(r - 1, r))
+            add(ui::mk_room_action(r, ui::room_action_move_up));
+        if (r + 1 < s.room_count() && !same(r + 1, r))
+            add(ui::mk_room_action(r, ui::room_action_move_down));
+        if (last)
+            add(ui::mk_room_action(r, ui::room_action_sell));
+    }
+}
+
+// scores every line by the sum of its rollouts, the same dice for every line
+void score_lines(list<press_line> &lines, const autoplay_options &opt, unsigned seed)
+{
+    const int n = int(lines.size()) * opt.rollouts;
+    vector<double> score(n);
+    run_parallel(n, opt.threads, [&](state &f, int i) {
+        f = lines[i / opt.rollouts].after.fork();
+        f.seed(seed, unsigned(i % opt.rollouts));
+        const int end = f.rolls + opt.horizon;
+        while (f.game_state() == state::gaming && f.rolls < end)
+            f.next_roll();
+        switch (f.game_state()) {
+        case state::won_by_panacea:
+            score[i] = 1e9 - f.rolls;
+            break;
+        case state::lost_by_debt:
+            score[i] = -1e9;
+            break;
+        case state::gaming:
+            score[i] = f.gold();
+            break;
+        }
+    });
+    for (int l = 0; l < int(lines.size()); ++l) {
+        lines[l].score = 0;
+        for (int k = 0; k < opt.rollouts; ++k)
+            lines[l].score += score[l * opt.rollouts + k];
+    }
+}
+
+}
+
+ui::signal autoplay_choose(const state &s, const autoplay_options &opt, unsigned seed)
+{
+    assert(opt.horizon > 0 && opt.rollouts > 0 && opt.beam > 0 && opt.depth > 0);
+    if (s.game_state() != state::gaming)
+        return ui::next_roll;
+
+    // pressing nothing is the first line, so it wins ties
+    list<press_line> beam;
+    beam.push_back(press_line{ {}, s.fork() });
+    score_lines(beam, opt, seed);
+    list<ui::signal> best;
+    double best_score = beam[0].score;
+    for (int d = 0; d < opt.depth; ++d) {
+        list<press_line> next;
+        for (const press_line &l : beam)
+            expand(l, next);
+        if (next.empty())
+            break;
+        score_lines(next, opt, seed);
+        for (const press_line &l : next) {
+            if (l.score > best_score) {
+                best = l.presses;
+                best_score = l.score;
+            }
+        }
+        // the best lines go on, in the order they were found among equal scores
+        stable_sort(next.begin(), next.end(), [](const press_line &a, const press_line &b) {
+            return a.score > b.score;
+        });
+        if (int(next.size()) > opt.beam)
+            next.erase(next.begin() + opt.beam, next.end());
+        beam = move(next);
+    }
+    return best.empty() ? ui::next_roll : best[0];
+}
+
+void policy_autoplay(state &s)
+{
+    const autoplay_options opt;
+    for (int i = 0; i < opt.presses; ++i) {
+        const ui::signal c = autoplay_choose(s, opt, unsigned(s.rolls) * 2654435761u + unsigned(i));
+        if (c == ui::next_roll || !s.btn(c))
+            return;
+    }
+}
+
+game_result play_game(unsigned seed, int max_rolls, policy p)
+{
+    state s;
+    return play_game(s, seed, max_rolls, p);
+}
+
+game_result play_game(state &s, unsigned seed, int max_rolls, policy p)
+{
+    s.seed(seed);
+    s.reset();
+    return finish_game(s, seed, max_rolls, p);
+}
+
+game_result finish_game(state &s, unsigned seed, int max_rolls, policy p)
+{
+    assert(max_rolls > 0);
+    assert(!s.ui_);
+    while (s.game_state() == state::gaming && s.rolls < max_rolls) {
+        if (p)
+            p(s);
+        s.next_roll();
+    }
+
+    game_result r;
+    r.seed = seed;
+    r.outcome = s.game_state();
+    r.rolls = s.rolls;
+    r.gold = s.gold();
+    return r;
+}
+
+void run_parallel(int n, int threads, const std::function<void(state &, int)> &job)
+{
+    if (n <= 0)
+        return;
+    if (threads <= 0)
+        threads = int(max(1u, thread::hardware_concurrency()));
+    // a job running its own jobs, like a policy searching inside play_games, keeps to its
+    // thread: the outer pool already has one per core
+    if (in_pool)
+        threads = 1;
+    threads = min(threads, n);
+
+    // every worker starts with its own contiguous range of jobs
+    vector<work_queue> queues(threads);
+    for (int i = 0; i < n; ++i)
+        queues[int(i * (long long)threads / n)].push_back(i);
+
+    auto work = [&](int w) {
+        const bool outer = in_pool;
+        in_pool = true;
+        state s;
+        int i = 0;
+        for (;;) {
+            bool got = queues[w].pop_front(i);
+            for (int k = 1; !got && k < threads; ++k)
+                got = queues[(w + k) % threads].pop_back(i);
+            if (!got)
+                break;
+            job(s, i);
+        }
+        in_pool = outer;
+    };
+    vector<thread> pool;
+    for (int w = 1; w < threads; ++w)
+        pool.emplace_back(work, w);
+    work(0);
+    for (thread &t : pool)
+        t.join();
+}
+
+vector<game_result> play_games(const vector<unsigned> &seeds, int max_rolls, int threads, policy p,
+                               state::dice_mode mode)
+{
+    vector<game_result> results(seeds.size());
+    run_parallel(int(seeds.size()), threads, [&](state &s, int i) {
+        s.dice_mode_ = mode;
+        results[i] = play_game(s, seeds[i], max_rolls, p);
+    });
+    return results;
+}
+
+vector<game_result> play_games(const snapshot_file &f, int max_rolls, int threads, policy p,
+                               state::dice_mode mode)
+{
+    vector<game_result> results(f.count());
+    run_parallel(f.count(), threads, [&](state &s, int i) {
+        s.dice_mode_ = mode;
+        results[i].seed = unsigned(i);
+        if (s.load(f.at(i)))
+            results[i] = finish_game(s, unsigned(i), max_rolls, p);
+    });
+    return results;
+}
+
+int play_rolls(state &s, int n)
+{
+    assert(!s.ui_);
+    int done = 0;
+    while (done < n) {
+        if (s.game_state() != state::gaming)
+            s.reset();
+        s.next_roll();
+        done++;
+    }
+    return done;
+}
+
+void sim_stats::add(const game_result &r)
+{
+    games++;
+    switch (r.outcome) {
+    case state::won_by_panacea:
+        won++;
+        rolls_won += r.rolls;
+        break;
+    case state::lost_by_debt:
+        lost++;
+        break;
+    case state::gaming:
+        unfinished++;
+        break;
+    }
+    rolls += r.rolls;
+    gold += r.gold;
+    rolls_min = rolls_min == -1 ? r.rolls : min(rolls_min, r.rolls);
+    rolls_max = rolls_max == -1 ? r.rolls : max(rolls_max, r.rolls);
+
+    for (const long long v : { (long long)r.outcome, (long long)r.rolls, (long long)r.gold }) {
+        digest ^= (unsigned long long)v;
+        digest *= 1099511628211ull;
+    }
+}
+
+void sim_stats::print(out &o) const
+{
+    if (!games) {
+        o << "no games played\n";
+        return;
+    }
+    o << "games: " << games << "\n"
+      << "won by panacea: " << won << " (" << 100.0 * won / games << "%)";
+    if (won)
+        o << ", avg " << double(rolls_won) / won << " rolls to win";
+    o << "\n"
+      << "lost by debt: " << lost << " (" << 100.0 * lost / games << "%)\n"
+      << "unfinished: " << unfinished << " (" << 100.0 * unfinished / games << "%)\n"
+      << "rolls per game: avg " << double(rolls) / games
+      << ", min " << rolls_min << ", max " << rolls_max << "\n"
+      << "final gold: avg " << double(gold) / games << "\n"
+      << "digest: " << std::hex << digest << std::dec << "\n";
+}
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <core.h>
+#include <snapshot.h>
+
+namespace ca {
+
+struct game_result
+{
+    unsigned seed = 0;
+    state::game outcome = state::gaming;
+    int rolls = 0;
+    int gold = 0;
+};
+
+// a player deciding what to press before each roll
+using policy = void (*)(state &);
+// buys the most expensive shop room as soon as it is affordable (that is the Panacea),
+// otherwise spends gold on the first affordable upgrade in rooms order
+void policy_greedy(state &);
+
+// what the auto-player looks at: sequences of every affordable buy, upgrade, move and sell
+// are pressed on forks of the game, which then roll horizon times idle with the same dice
+// for every sequence; a beam search keeps the beam best sequences to press one more after
+struct autoplay_options
+{
+    int horizon = 40;
+    // games played forward per sequence, with different dice
+    int rollouts = 4;
+    // sequences kept per step and presses in a sequence at most
+    int beam = 3;
+    int depth = 2;
+    // signals pressed before a roll at most
+    int presses = 8;
+    // threads of the rollouts, 1 when the search runs in a job of run_parallel
+    int threads = 0;
+};
+
+// the first signal of the sequence giving the most gold on average after the horizon, a win
+// counts above any gold and a loss below; ui::next_roll if pressing nothing is as good as
+// anything else. the result depends on seed but not on the threads count
+ui::signal autoplay_choose(const state &, const autoplay_options &, unsigned seed);
+// presses what autoplay_choose finds with the default options until nothing is better
+void policy_autoplay(state &);
+
+// plays a whole game without ui until it ends or max_rolls are done
+game_result play_game(unsigned seed, int max_rolls, policy = nullptr);
+game_result play_game(state &, unsigned seed, int max_rolls, policy = nullptr);
+
+// continues a game to its end or until max_rolls are done
+game_result finish_game(state &, unsigned seed, int max_rolls, policy = nullptr);
+
+// runs job(s, i) for every i in [0, n) on a pool of threads stealing jobs from each other,
+// each thread reuses its own state (threads <= 0 means one per hardware thread);
+// called from inside a job it runs all jobs on the calling thread
+void run_parallel(int n, int threads, const std::function<void(state &, int)> &job);
+
+// plays a game per seed in parallel; results are in the seeds order
+// and do not depend on the threads count
+vector<game_result> play_games(const vector<unsigned> &seeds, int max_rolls,
+                               int threads = 0, policy = nullptr,
+                               state::dice_mode = state::dice_exact);
+// finishes a game per saved snapshot in parallel
+vector<game_result> play_games(const snapshot_file &, int max_rolls,
+                               int threads = 0, policy = nullptr,
+                               state::dice_mode = state::dice_exact);
+
+// does n rolls on a single state, restarting it whenever the game ends
+int play_rolls(state &s, int n);
+
+struct sim_stats
+{
+    void add(const game_result &);
+    void print(out &) const;
+    int games = 0;
+    int won = 0;
+    int lost = 0;
+    int unfinished = 0;
+    long long rolls = 0;
+    long long rolls_won = 0;
+    long long gold = 0;
+    int rolls_min = -1;
+    int rolls_max = -1;
+    unsigned long long digest = 14695981039346656037ull;
+};
+
+}
@@ -0,0 +1,313 @@
+#include <replay.h>
+#include <sim.h>
+#include <stream.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace ca;
+
+namespace {
+
+int usage()
+{
+    cerr << "usage: cat_sim rolls <n> [-s seed] [-d exact|fast] [-P profile.csv]\n"
+            "       cat_sim games <n> [-r max_rolls] [-s seed] [-j threads] [-p idle|greedy|auto] [-d exact|fast]\n"
+            "       cat_sim snapshots <n> <file> [-r rolls] [-s seed] [-p idle|greedy|auto]\n"
+            "       cat_sim resume <file> [-r max_rolls] [-j threads] [-p idle|greedy|auto] [-d exact|fast]\n"
+            "       cat_sim record <file> [-r rolls] [-s seed] [-p idle|greedy|auto]\n"
+            "       cat_sim replay <file> [-n times]\n"
+            "       cat_sim frames <n> [-s seed] [-p idle|greedy|auto] > stream\n"
+            "       cat_sim render < stream\n"
+            "       cat_sim opening <rolls> [-s seed] [-j threads]\n"
+            "       cat_sim away <file> <seconds> [-d exact|fast]\n"
+            "policy auto searches every choice on forks of the game before each roll\n";
+    return 1;
+}
+
+struct options
+{
+    int max_rolls = 1000;
+    unsigned seed = 0;
+    int threads = 0;
+    int times = 1;
+    policy p = nullptr;
+    state::dice_mode dice = state::dice_exact;
+    const char *profile = nullptr;
+    bool parse(int argc, char **argv, int first);
+};
+
+bool options::parse(int argc, char **argv, int first)
+{
+    for (int i = first; i < argc; i += 2) {
+        if (i + 1 >= argc)
+            return false;
+        const char *key = argv[i];
+        const char *value = argv[i + 1];
+        if (!strcmp(key, "-r"))
+            max_rolls = atoi(value);
+        else if (!strcmp(key, "-s"))
+            seed = unsigned(strtoul(value, nullptr, 10));
+        else if (!strcmp(key, "-j"))
+            threads = atoi(value);
+        else if (!strcmp(key, "-d") && !strcmp(value, "exact"))
+            dice = state::dice_exact;
+        else if (!strcmp(key, "-d") && !strcmp(value, "fast"))
+            dice = state::dice_fast;
+        else if (!strcmp(key, "-P"))
+            profile = value;
+        else if (!strcmp(key, "-n"))
+            times = atoi(value);
+        else if (!strcmp(key, "-p") && !strcmp(value, "idle"))
+            p = nullptr;
+        else if (!strcmp(key, "-p") && !strcmp(value, "greedy"))
+            p = policy_greedy;
+        else if (!strcmp(key, "-p") && !strcmp(value, "auto"))
+            p = policy_autoplay;
+        else
+            return false;
+    }
+    return max_rolls > 0 && times > 0;
+}
+
+// plays a game through state::btn as a player would and saves the input log
+int record(const char *path, const options &opt)
+{
+    state s;
+    input_log log;
+    log.record(s, opt.seed);
+    while (s.game_state() == state::gaming && s.rolls < opt.max_rolls) {
+        if (opt.p)
+            opt.p(s);
+        s.btn(ui::next_roll);
+    }
+    log.finish(s);
+    if (!log.save(path)) {
+        cerr << "can't write " << path << "\n";
+        return 1;
+    }
+    cout << "signals: " << log.signals.size() << ", rolls: " << log.rolls
+         << ", gold: " << log.gold << "\n";
+    return 0;
+}
+
+// replays an input log as fast as possible and checks the result
+int replay(const char *path, const options &opt)
+{
+    input_log log;
+    if (!log.load(path)) {
+        cerr << "can't read " << path << "\n";
+        return 1;
+    }
+    using clock = chrono::steady_clock;
+    const auto start = clock::now();
+    bool ok = true;
+    state s;
+    for (int i = 0; i < opt.times; ++i)
+        ok = replay(log, s) && ok;
+    const double sec = chrono::duration<double>(clock::now() - start).count();
+
+    cout << (ok ? "replay matches" : "replay DIFFERS") << ": gold " << s.gold() << " (" << log.gold
+         << "), rolls " << s.rolls << " (" << log.rolls << ")\n"
+         << "signals: " << log.signals.size() * opt.times << "\n"
+         << "time: " << sec << " s\n"
+         << "rolls/sec: " << (sec > 0 ? double(s.rolls) * opt.times / sec : 0.0) << "\n";
+    return ok ? 0 : 2;
+}
+
+// plays n rolls drawing a frame after each one into a ui_stream on stdout
+int frames(int n, const options &opt)
+{
+    ui_stream o(1);
+    state s;
+    s.seed(opt.seed);
+    s.reset();
+    s.draw(o);
+    for (int i = 0; i < n && s.game_state() == state::gaming; ++i) {
+        if (opt.p)
+            opt.p(s);
+        s.next_roll();
+        s.draw(o);
+    }
+    return o.ok() ? 0 : 1;
+}
+
+// catches up the game saved in a snapshot file as if it was closed for the seconds
+int away(const char *path, double seconds, const options &opt)
+{
+    state s;
+    s.dice_mode_ = opt.dice;
+    if (!load_snapshot(s, path)) {
+        cerr << "can't read a snapshot from " << path << "\n";
+        return 1;
+    }
+    catch_up_options co;
+    co.progress = [](long long done, long long due) {
+        cerr << "\r" << done << "/" << due << " rolls";
+        return true;
+    };
+    const catch_up_summary sum = s.catch_up(seconds, co);
+    cerr << "\n";
+    const char *why = sum.stopped == skip_summary::debt_arrived ? "a debt collector arrived"
+            : sum.stopped == skip_summary::game_over ? "the game is over"
+            : sum.rolls < sum.due ? "out of time"
+            : "all rolls done";
+    cout << "rolls: " << sum.rolls << " of " << sum.due << " (" << why << ")\n"
+         << "gold: " << (sum.gold >= 0 ? "+" : "") << sum.gold << ", now " << s.gold() << "\n"
+         << "time: " << sum.ms << " ms\n";
+    return 0;
+}
+
+// what pressing the signal does, in words
+str describe(const state &s, ui::signal c)
+{
+    int r, u;
+    if (ui::rd_room_buy(c, r))
+        return str("buy ") + s.shop_at(r).name();
+    if (ui::rd_room_upgrade(c, r, u))
+        return "upgrade " + to_string(u + 1) + " of " + to_string(r + 1) + ". " + s.room_at(r).name();
+    if (ui::rd_room_action(c, r, u)) {
+        const char *action = u == ui::room_action_sell ? "sell "
+                : u == ui::room_action_move_up ? "move up "
+                : "move down ";
+        return action + to_string(r + 1) + ". " + s.room_at(r).name();
+    }
+    return "signal " + to_string(int(c));
+}
+
+// plays the first rolls of a game with the auto-player and prints what it pressed
+int opening(int n, const options &opt)
+{
+    autoplay_options ao;
+    ao.threads = opt.threads;
+    state s;
+    s.seed(opt.seed);
+    s.reset();
+    while (s.game_state() == state::gaming && s.rolls < n) {
+        for (int i = 0; i < ao.presses; ++i) {
+            const ui::signal c = autoplay_choose(s, ao, unsigned(s.rolls) * 2654435761u + unsigned(i));
+            const str what = describe(s, c);
+            if (c == ui::next_roll || !s.btn(c))
+                break;
+            cout << "roll " << s.rolls << ": " << what << ", gold left " << s.gold() << "\n";
+        }
+        s.next_roll();
+    }
+    cout << "after " << s.rolls << " rolls: gold " << s.gold() << ", rooms " << s.room_count()
+         << (s.game_state() == state::won_by_panacea ? ", won" : s.game_state() == state::lost_by_debt ? ", lost" : "")
+         << "\n";
+    return 0;
+}
+
+// replays a ui_stream from stdin as html on stdout
+int render()
+{
+    ui_cmd o(cout);
+    ui_stream_reader r(0);
+    const bool ok = r.replay(o);
+    cout << "\n";
+    cerr << r.frames() << " frames" << (ok ? "" : ", malformed stream") << "\n";
+    return ok ? 0 : 1;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 2 && !strcmp(argv[1], "render"))
+        return render();
+    if (argc < 3)
+        return usage();
+
+    using clock = chrono::steady_clock;
+    const char *mode = argv[1];
+    if (!strcmp(mode, "away")) {
+        options opt;
+        if (argc < 4 || !opt.parse(argc, argv, 4))
+            return usage();
+        return away(argv[2], atof(argv[3]), opt);
+    }
+    if (!strcmp(mode, "record") || !strcmp(mode, "replay")) {
+        options opt;
+        if (!opt.parse(argc, argv, 3))
+            return usage();
+        return !strcmp(mode, "record") ? record(argv[2], opt) : replay(argv[2], opt);
+    }
+    const bool resume = !strcmp(mode, "resume");
+    const bool snapshots = !strcmp(mode, "snapshots");
+    const int n = resume ? 1 : atoi(argv[2]);
+    const char *path = resume ? argv[2] : snapshots && argc > 3 ? argv[3] : nullptr;
+    options opt;
+    if (n <= 0 || !opt.parse(argc, argv, path ? (resume ? 3 : 4) : 3) || ((resume || snapshots) && !path))
+        return usage();
+    if (!strcmp(mode, "frames"))
+        return frames(n, opt);
+    if (!strcmp(mode, "opening"))
+        return opening(n, opt);
+
+    long long rolls = 0;
+    const auto start = clock::now();
+    if (!strcmp(mode, "rolls")) {
+        state s;
+        room_profile profile;
+        if (opt.profile)
+            s.profile_ = &profile;
+        s.dice_mode_ = opt.dice;
+        s.seed(opt.seed);
+        s.reset();
+        rolls = play_rolls(s, n);
+        if (opt.profile) {
+            ofstream f(opt.profile);
+            profile.write_csv(f, s);
+            if (!f) {
+                cerr << "can't write " << opt.profile << "\n";
+                return 1;
+            }
+        }
+    } else if (!strcmp(mode, "games")) {
+        ca::vector<unsigned> seeds(n);
+        for (int i = 0; i < n; ++i)
+            seeds[i] = opt.seed + unsigned(i);
+        sim_stats stats;
+        for (const game_result &r : play_games(seeds, opt.max_rolls, opt.threads, opt.p, opt.dice))
+            stats.add(r);
+        rolls = stats.rolls;
+        stats.print(cout);
+    } else if (snapshots) {
+        remove(path);
+        state s;
+        for (int i = 0; i < n; ++i) {
+            rolls += play_game(s, opt.seed + unsigned(i), opt.max_rolls, opt.p).rolls;
+            if (!append_snapshot(s, path)) {
+                cerr << "can't write " << path << "\n";
+                return 1;
+            }
+        }
+    } else if (resume) {
+        snapshot_file f;
+        if (!f.open(path)) {
+            cerr << "can't read snapshots from " << path << "\n";
+            return 1;
+        }
+        sim_stats stats;
+        for (const game_result &r : play_games(f, opt.max_rolls, opt.threads, opt.p, opt.dice))
+            stats.add(r);
+        rolls = stats.rolls;
+        for (int i = 0; i < f.count(); ++i)
+            rolls -= f.at(i).rolls;
+        stats.print(cout);
+    } else {
+        return usage();
+    }
+    const double sec = chrono::duration<double>(clock::now() - start).count();
+
+    cout << "rolls: " << rolls << "\n"
+         << "time: " << sec << " s\n"
+         << "rolls/sec: " << (sec > 0 ? rolls / sec : 0.0) << "\n";
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include <snapshot.h>
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace ca {
+
+static_assert(is_trivially_copyable<random_engine>::value, "rng state is copied as raw bytes");
+
+bool snapshot::valid() const
+{
+    const snapshot expected;
+    return !memcmp(magic, expected.magic, sizeof(magic))
+            && version == current_version
+            && size == int32_t(sizeof(snapshot))
+            && state::gaming <= game && game <= state::won_by_panacea
+            && 0 <= rooms_count && rooms_count <= ui::max_rooms
+            && 0 <= shop_count && shop_count <= max_shop;
+}
+
+bool state::save(snapshot &s) const
+{
+    if (room_count() > ui::max_rooms || shop_count() > snapshot::max_shop)
+        return false;
+    s = snapshot{};
+    s.gold = gold_;
+    s.rolls = rolls;
+    s.game = state_;
+    for (int i = 0; i < dice_pool::faces; ++i)
+        s.dice[i] = dice_.count(dice_pool::hash(i));
+    s.rooms_count = int32_t(room_count());
+    for (int i = 0; i < s.rooms_count; ++i)
+        room_at(i).save(s.rooms[i]);
+    s.shop_count = int32_t(shop_count());
+    for (int i = 0; i < s.shop_count; ++i)
+        shop_at(i).save(s.shop[i]);
+    memcpy(s.rng, &rng_, sizeof(s.rng));
+    return true;
+}
+
+bool state::load(const snapshot &s)
+{
+    if (!s.valid() || s.gold < 0 || s.rolls < 0)
+        return false;
+
+    auto load_rooms = [this](const snapshot_room *from, int count, list<shared<room>> &to) {
+        to.clear();
+        for (int i = 0; i < count; ++i) {
+            shared<room> r(room::create(room_type(from[i].type), allocator()));
+            if (!r || !r->load(from[i]))
+                return false;
+            to.push_back(r);
+        }
+        return true;
+    };
+    state loaded(arena_);
+    if (!load_rooms(s.rooms, s.rooms_count, loaded.mut_layout_().rooms)
+            || !load_rooms(s.shop, s.shop_count, loaded.mut_layout_().shop))
+        return false;
+    for (int i = 0; i < dice_pool::faces; ++i) {
+        if (s.dice[i] < 0)
+            return false;
+        if (s.dice[i])
+            loaded.dice_.inc(dice_pool::hash(i), s.dice[i]);
+    }
+    loaded.index_rooms_();
+    for (int r : loaded.rooms_of(rt_debt_collector))
+        loaded.track_debt_(loaded.room_at(r), 1);
+    loaded.gold_ = s.gold;
+    loaded.rolls = s.rolls;
+    loaded.state_ = game(s.game);
+    memcpy(&loaded.rng_, s.rng, sizeof(s.rng));
+    loaded.ui_ = ui_;
+    loaded.frames_ = frames_;
+    loaded.recorded_ = recorded_;
+    loaded.profile_ = profile_;
+    loaded.estimator_ = estimator_;
+    loaded.dice_mode_ = dice_mode_;
+    *this = loaded;
+    return true;
+}
+
+namespace {
+
+bool write_snapshot(const state &s, const char *path, const char *mode)
+{
+    snapshot shot;
+    if (!s.save(shot))
+        return false;
+    shot.saved_at = int64_t(time(nullptr));
+    FILE *f = fopen(path, mode);
+    if (!f)
+        return false;
+    const bool ok = fwrite(&shot, sizeof(shot), 1, f) == 1;
+    return fclose(f) == 0 && ok;
+}
+
+}
+
+bool save_snapshot(const state &s, const char *path)
+{
+    return write_snapshot(s, path, "wb");
+}
+
+bool append_snapshot(const state &s, const char *path)
+{
+    return write_snapshot(s, path, "ab");
+}
+
+bool load_snapshot(state &s, const char *path, int64_t *saved_at)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    auto shot = std::make_unique<snapshot>();
+    const bool ok = fread(shot.get(), sizeof(snapshot), 1, f) == 1;
+    fclose(f);
+    if (!ok || !s.load(*shot))
+        return false;
+    if (saved_at)
+        *saved_at = shot->saved_at;
+    return true;
+}
+
+snapshot_file::~snapshot_file()
+{
+    close();
+}
+
+bool snapshot_file::open(const char *path)
+{
+    close();
+#ifndef _WIN32
+    const int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size % sizeof(snapshot)) {
+        ::close(fd);
+        return false;
+    }
+    if (st.st_size) {
+        void *p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        data_ = static_cast<const snapshot *>(p);
+        mapped_ = size_t(st.st_size);
+    }
+    ::close(fd);
+    count_ = int(st.st_size / sizeof(snapshot));
+#else
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    snapshot shot;
+    while (fread(&shot, sizeof(shot), 1, f) == 1)
+        copy_.push_back(shot);
+    fclose(f);
+    data_ = copy_.data();
+    count_ = int(copy_.size());
+#endif
+    for (int i = 0; i < count_; ++i) {
+        if (!data_[i].valid()) {
+            close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void snapshot_file::close()
+{
+#ifndef _WIN32
+    if (mapped_)
+        munmap(const_cast<snapshot *>(data_), mapped_);
+#endif
+    data_ = nullptr;
+    count_ = 0;
+    mapped_ = 0;
+    copy_.clear();
+}
+
+}
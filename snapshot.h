@@ -0,0 +1,68 @@
+#pragma once
+
+#include <core.h>
+
+#include <cstdint>
+#include <type_traits>
+
+namespace ca {
+
+struct snapshot_room
+{
+    enum { max_upgrades = room::max_upgrades };
+    int32_t type = rt_invalid;
+    int32_t activates = 0;
+    int32_t levels[max_upgrades] = {};
+    int32_t waits_gold = 0;
+    int32_t waits_gold_total = 0;
+};
+
+// the whole game as a fixed size plain struct, so it is saved and loaded
+// by a single write/read, or used right from a mapped file, with no parsing
+struct snapshot
+{
+    enum { current_version = 3, max_shop = 16 };
+    char magic[4] = { 'C', 'A', 'S', 'V' };
+    int32_t version = current_version;
+    int32_t size = sizeof(snapshot);
+    int32_t gold = 0;
+    int32_t rolls = 0;
+    int32_t game = state::gaming;
+    // seconds since the epoch when the snapshot was written to a file, 0 if never
+    int64_t saved_at = 0;
+    int32_t dice[dice_pool::faces] = {};
+    int32_t rooms_count = 0;
+    int32_t shop_count = 0;
+    snapshot_room rooms[ui::max_rooms];
+    snapshot_room shop[max_shop];
+    unsigned char rng[sizeof(random_engine)] = {};
+    // the header matches this build and counts are in range
+    bool valid() const;
+};
+static_assert(std::is_trivially_copyable<snapshot>::value, "snapshot is written as raw bytes");
+
+bool save_snapshot(const state &, const char *path);
+// saved_at, if given, gets the time the snapshot was written
+bool load_snapshot(state &, const char *path, int64_t *saved_at = nullptr);
+// appends a snapshot to a file of snapshots going back to back
+bool append_snapshot(const state &, const char *path);
+
+// a file of snapshots going back to back, mapped into memory read-only
+struct snapshot_file
+{
+    snapshot_file() = default;
+    snapshot_file(const snapshot_file &) = delete;
+    snapshot_file &operator=(const snapshot_file &) = delete;
+    ~snapshot_file();
+    bool open(const char *path);
+    void close();
+    int count() const { return count_; }
+    const snapshot &at(int i) const { assert(0 <= i && i < count_); return data_[i]; }
+private:
+    const snapshot *data_ = nullptr;
+    int count_ = 0;
+    size_t mapped_ = 0;
+    vector<snapshot> copy_;
+};
+
+}
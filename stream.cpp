@@ -0,0 +1,281 @@
+#include <stream.h>
+#include <varint.h>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#define read _read
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace ca {
+
+const char ui_stream::magic[4] = { 'C', 'A', 'U', 'I' };
+
+ui_stream::ui_stream(int fd) : fd_(fd)
+{
+    assert(fd >= 0);
+    buf_.append(magic, sizeof(magic));
+    buf_.push_back(char(version));
+}
+
+ui_stream::~ui_stream()
+{
+    write_out();
+}
+
+ui &ui_stream::operator <<(int i)
+{
+    put(op_int);
+    put_varint(i);
+    return *this;
+}
+
+ui &ui_stream::operator <<(double d)
+{
+    static_assert(sizeof(double) == 8, "doubles are written as raw 8 bytes");
+    put(op_double);
+    char b[sizeof(d)];
+    memcpy(b, &d, sizeof(d));
+    buf_.append(b, sizeof(b));
+    return *this;
+}
+
+ui &ui_stream::operator <<(const str &s)
+{
+    put_str(s.data(), s.size());
+    return *this;
+}
+
+ui &ui_stream::operator <<(const char *s)
+{
+    put_str(s, strlen(s));
+    return *this;
+}
+
+ui &ui_stream::operator <<(symbol s)
+{
+    put(op_symbol);
+    put_varint(s);
+    return *this;
+}
+
+void ui_stream::nl() { put(op_nl); }
+void ui_stream::begin_room() { put(op_begin_room); }
+void ui_stream::end_room() { put(op_end_room); }
+void ui_stream::begin_upgrade() { put(op_begin_upgrade); }
+void ui_stream::end_upgrade() { put(op_end_upgrade); }
+void ui_stream::end_button() { put(op_end_button); }
+void ui_stream::begin_paragraph() { put(op_begin_paragraph); }
+void ui_stream::end_paragraph() { put(op_end_paragraph); }
+void ui_stream::begin_list() { put(op_begin_list); }
+void ui_stream::end_list() { put(op_end_list); }
+void ui_stream::end_section() { put(op_end_section); }
+
+void ui_stream::flush()
+{
+    put(op_flush);
+    write_out();
+}
+
+void ui_stream::begin_button(signal s)
+{
+    put(op_begin_button);
+    put_varint(s);
+}
+
+void ui_stream::begin_section(section s, int index)
+{
+    put(op_begin_section);
+    put_varint(s);
+    put_varint(index);
+}
+
+void ui_stream::put(op o)
+{
+    buf_.push_back(char(o));
+}
+
+void ui_stream::put_varint(long long v)
+{
+    ca::put_varint(buf_, v);
+}
+
+void ui_stream::put_str(const char *s, size_t n)
+{
+    n = min(n, size_t(max_str));
+    put(op_str);
+    put_varint((long long)n);
+    buf_.append(s, n);
+}
+
+void ui_stream::write_out()
+{
+    size_t done = 0;
+    while (ok_ && done < buf_.size()) {
+        const auto n = write(fd_, buf_.data() + done, unsigned(buf_.size() - done));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            ok_ = false;
+        else
+            done += size_t(n);
+    }
+    buf_.clear();
+}
+
+bool ui_stream_reader::replay(ui &o)
+{
+    while (replay_frame(o)) {}
+    return header_ && !error_;
+}
+
+bool ui_stream_reader::replay_frame(ui &o)
+{
+    if (!header())
+        return fail();
+
+    unsigned char op = 0;
+    long long a = 0, b = 0;
+    while (get(op)) {
+        switch (op) {
+        case ui_stream::op_int:
+            if (!get_varint(a))
+                return fail();
+            o << int(a);
+            break;
+        case ui_stream::op_double: {
+            double d = 0;
+            char raw[sizeof(d)];
+            if (!get_bytes(raw, sizeof(raw)))
+                return fail();
+            memcpy(&d, raw, sizeof(d));
+            o << d;
+            break;
+        }
+        case ui_stream::op_str:
+            if (!get_varint(a) || a < 0 || a > ui_stream::max_str)
+                return fail();
+            text_.resize(size_t(a));
+            if (!get_bytes(&text_[0], text_.size()))
+                return fail();
+            o << text_;
+            break;
+        case ui_stream::op_symbol:
+            if (!get_varint(a))
+                return fail();
+            o << ui::symbol(a);
+            break;
+        case ui_stream::op_nl:
+            o.nl();
+            break;
+        case ui_stream::op_flush:
+            o.flush();
+            frames_++;
+            return true;
+        case ui_stream::op_begin_room:
+            o.begin_room();
+            break;
+        case ui_stream::op_end_room:
+            o.end_room();
+            break;
+        case ui_stream::op_begin_upgrade:
+            o.begin_upgrade();
+            break;
+        case ui_stream::op_end_upgrade:
+            o.end_upgrade();
+            break;
+        case ui_stream::op_begin_button:
+            if (!get_varint(a))
+                return fail();
+            o.begin_button(ui::signal(a));
+            break;
+        case ui_stream::op_end_button:
+            o.end_button();
+            break;
+        case ui_stream::op_begin_paragraph:
+            o.begin_paragraph();
+            break;
+        case ui_stream::op_end_paragraph:
+            o.end_paragraph();
+            break;
+        case ui_stream::op_begin_list:
+            o.begin_list();
+            break;
+        case ui_stream::op_end_list:
+            o.end_list();
+            break;
+        case ui_stream::op_begin_section:
+            if (!get_varint(a) || !get_varint(b))
+                return fail();
+            o.begin_section(ui::section(a), int(b));
+            break;
+        case ui_stream::op_end_section:
+            o.end_section();
+            break;
+        default:
+            return fail();
+        }
+    }
+    return false;
+}
+
+bool ui_stream_reader::fail()
+{
+    error_ = true;
+    return false;
+}
+
+bool ui_stream_reader::header()
+{
+    if (header_)
+        return true;
+    char h[sizeof(ui_stream::magic) + 1];
+    if (!get_bytes(h, sizeof(h)))
+        return false;
+    header_ = !memcmp(h, ui_stream::magic, sizeof(ui_stream::magic)) && h[4] == ui_stream::version;
+    return header_;
+}
+
+bool ui_stream_reader::get(unsigned char &c)
+{
+    char b = 0;
+    if (!get_bytes(&b, 1))
+        return false;
+    c = (unsigned char)b;
+    return true;
+}
+
+bool ui_stream_reader::get_varint(long long &v)
+{
+    return ca::get_varint([this](unsigned char &c) { return get(c); }, v);
+}
+
+bool ui_stream_reader::get_bytes(char *dst, size_t n)
+{
+    while (n) {
+        if (pos_ == size_) {
+            const auto got = read(fd_, buf_, unsigned(sizeof(buf_)));
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                return false;
+            pos_ = 0;
+            size_ = size_t(got);
+        }
+        const size_t k = min(n, size_ - pos_);
+        memcpy(dst, buf_ + pos_, k);
+        pos_ += k;
+        dst += k;
+        n -= k;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <core.h>
+
+namespace ca {
+
+// writes the ui hooks as a compact binary event stream into a file descriptor:
+// a header, then an opcode byte per hook with varint (or raw double) arguments;
+// events are buffered and written on flush(), which also marks a frame end
+struct ui_stream : ui
+{
+    ui_stream(int fd);
+    ~ui_stream() override;
+    ui &operator<<(int) override;
+    ui &operator<<(double) override;
+    ui &operator<<(const str &s) override;
+    ui &operator<<(const char *) override;
+    ui &operator<<(symbol) override;
+    void nl() override;
+    void flush() override;
+    void begin_room() override;
+    void end_room() override;
+    void begin_upgrade() override;
+    void end_upgrade() override;
+    void begin_button(signal) override;
+    void end_button() override;
+    void begin_paragraph() override;
+    void end_paragraph() override;
+    void begin_list() override;
+    void end_list() override;
+    void begin_section(section, int index) override;
+    void end_section() override;
+    bool ok() const { return ok_; }
+
+    enum op : unsigned char
+    {
+        op_int = 1,
+        op_double,
+        op_str,
+        op_symbol,
+        op_nl,
+        op_flush,
+        op_begin_room,
+        op_end_room,
+        op_begin_upgrade,
+        op_end_upgrade,
+        op_begin_button,
+        op_end_button,
+        op_begin_paragraph,
+        op_end_paragraph,
+        op_begin_list,
+        op_end_list,
+        op_begin_section,
+        op_end_section,
+    };
+    static const char magic[4];
+    // strings are cut at max_str bytes, a reader rejects longer ones as malformed
+    enum { version = 1, max_str = 1 << 20 };
+private:
+    void put(op);
+    void put_varint(long long);
+    void put_str(const char *, size_t);
+    void write_out();
+    int fd_ = -1;
+    str buf_;
+    bool ok_ = true;
+};
+
+// reads a ui_stream and replays its events onto any other ui
+struct ui_stream_reader
+{
+    ui_stream_reader(int fd) : fd_(fd) {}
+    // replays everything until the end of the stream, false if it is malformed
+    bool replay(ui &);
+    // replays events up to and including the next flush, false at the end or on error
+    bool replay_frame(ui &);
+    int frames() const { return frames_; }
+private:
+    bool header();
+    bool fail();
+    bool get(unsigned char &);
+    bool get_varint(long long &);
+    bool get_bytes(char *, size_t);
+    int fd_ = -1;
+    char buf_[4096];
+    size_t pos_ = 0;
+    size_t size_ = 0;
+    bool header_ = false;
+    bool error_ = false;
+    int frames_ = 0;
+    str text_;
+};
+
+}
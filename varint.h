@@ -0,0 +1,47 @@
+#pragma once
+
+#include <core.h>
+
+namespace ca {
+
+// zigzag varints, 7 bits a byte: small numbers are short, negative ones too
+
+inline void put_varint(str &o, long long v)
+{
+    unsigned long long u = (unsigned long long)(v) << 1 ^ (unsigned long long)(v >> 63);
+    while (u >= 0x80) {
+        o.push_back(char(u | 0x80));
+        u >>= 7;
+    }
+    o.push_back(char(u));
+}
+
+// reads a varint byte by byte with next(unsigned char &), which is false at the end of input
+template<typename next_t>
+bool get_varint(next_t next, long long &v)
+{
+    unsigned long long u = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char c = 0;
+        if (!next(c))
+            return false;
+        u |= (unsigned long long)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            v = (long long)(u >> 1) ^ -(long long)(u & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline bool get_varint(const str &in, size_t &pos, long long &v)
+{
+    return get_varint([&](unsigned char &c) {
+        if (pos >= in.size())
+            return false;
+        c = (unsigned char)in[pos++];
+        return true;
+    }, v);
+}
+
+}